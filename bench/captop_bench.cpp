@@ -0,0 +1,351 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+//
+// captop_bench: microbenchmarks of the hot paths (handler dispatch and
+// meters, range filter, counters, generator, stats formatting) on
+// synthetic packets. Every benchmark reports the median of a few runs in
+// ns and cycles per operation; results can be saved and compared with a
+// baseline file ("name ns cycles" per line).
+//
+
+#include <pcap/pcap.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+
+#include <capthread.hpp>
+#include <handler.hpp>
+#include <global.hpp>
+#include <options.hpp>
+#include <nulldev.hpp>
+#include <packet.hpp>
+#include <probe.hpp>
+#include <util.hpp>
+#include <tsc.hpp>
+#include <report.hpp>
+#include <generator.hpp>
+
+
+struct result
+{
+    std::string name;
+    double ns;              // per operation
+    double cycles;
+};
+
+
+struct bench
+{
+    std::string name;
+    std::function<void(size_t)> run;        // n operations
+};
+
+
+static const size_t runs = 5;
+
+
+//
+// median of the runs, n calibrated so that a run takes ~100 msec...
+//
+
+static result
+measure(bench const &b, size_t iterations)
+{
+    auto n = iterations;
+
+    if (n == 0)
+    {
+        n = 1024;
+        for(;;)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            b.run(n);
+            auto dt = std::chrono::steady_clock::now() - t0;
+            if (dt > std::chrono::milliseconds(20) || n > (size_t(1) << 32))
+                break;
+            n *= 4;
+        }
+        n *= 5;
+    }
+
+    std::vector<double> ns, cycles;
+
+    for(size_t r = 0; r < runs; r++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        auto c0 = tsc::start();
+        b.run(n);
+        auto c1 = tsc::stop();
+        auto t1 = std::chrono::steady_clock::now();
+
+        ns.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() / n);
+        cycles.push_back(static_cast<double>(c1 - c0) / n);
+    }
+
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+
+    return { b.name, ns[runs/2], cycles[runs/2] };
+}
+
+
+//
+// capture thread context as set up by thread_setup...
+//
+
+static std::unique_ptr<capthread>
+make_context(pcap_t *dead)
+{
+    std::unique_ptr<capthread> ctx(new capthread);
+    ctx->in = dead;
+    return ctx;
+}
+
+
+template <typename T>
+static inline void keep(T const &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+
+static std::vector<bench>
+benchmarks(nulldev::trace const &t, pcap_t *dead)
+{
+    std::vector<bench> ret;
+
+    // the handler over the synthetic packets, with a given context...
+    //
+
+    auto replay = [&t] (capthread *ctx, pcap_handler h, size_t n) {
+        auto user = reinterpret_cast<u_char *>(ctx);
+        for(size_t i = 0, k = 0; i < n; i++)
+        {
+            h(user, &t.hdr[k], &t.data[t.offset[k]]);
+            if (++k == t.size())
+                k = 0;
+        }
+    };
+
+    auto plain = std::make_shared<std::unique_ptr<capthread>>(make_context(dead));
+
+    ret.push_back({ "handler", [=] (size_t n) {
+        replay(plain->get(), captop_handler, n);
+    }});
+
+    auto timed = std::make_shared<std::unique_ptr<capthread>>(make_context(dead));
+    (*timed)->latency.reset(new capthread::latency_stat(64));
+    auto timed_h = instrument_handler(default_options, timed->get(), captop_handler);
+
+    ret.push_back({ "handler.timed", [=] (size_t n) {
+        replay(timed->get(), timed_h, n);
+    }});
+
+    auto meters = std::make_shared<std::unique_ptr<capthread>>(make_context(dead));
+    (*meters)->breakdown.reset(new breakdown::meter);
+    (*meters)->sizes.reset(new sizes::meter(false));
+    (*meters)->flows.reset(new flows::meter(8192));
+    (*meters)->layers = packet::l4;
+    auto meters_h = instrument_handler(default_options, meters->get(), captop_handler);
+
+    ret.push_back({ "handler.meters", [=] (size_t n) {
+        replay(meters->get(), meters_h, n);
+    }});
+
+    ret.push_back({ "packet.parse", [&t] (size_t n) {
+        captop_packet p;
+        for(size_t i = 0, k = 0; i < n; i++)
+        {
+            packet::parse<packet::l4>(&t.data[t.offset[k]], t.hdr[k].caplen, p);
+            keep(p);
+            if (++k == t.size())
+                k = 0;
+        }
+    }});
+
+    auto rf = std::make_shared<range_filter>("1-100,1024,8000-8010,65536-131072");
+
+    ret.push_back({ "range_filter", [=] (size_t n) {
+        size_t hits = 0;
+        for(size_t i = 0; i < n; i++)
+            hits += (*rf)(i & 0x3ffff);
+        keep(hits);
+    }});
+
+    auto stats = std::make_shared<std::vector<capthread::stat>>(16, capthread::stat{1, 2, 3, 4, 5});
+
+    ret.push_back({ "stat.sum16", [=] (size_t n) {
+        for(size_t i = 0; i < n; i++)
+        {
+            (*stats)[i & 15].in_count++;
+            auto s = sum(*stats) - (*stats)[0];
+            keep(s);
+        }
+    }});
+
+    ret.push_back({ "generator.packet", [] (size_t n) {
+        generator::frame frame(true, true, 0);
+        for(size_t i = 0; i < n; i++)
+            keep(frame.next(i));
+    }});
+
+    ret.push_back({ "format.stats", [] (size_t n) {
+        std::ostringstream out;
+        capthread::stat t{0, 0, 0, 0, 0}, t_{0, 0, 0, 0, 0};
+        for(size_t i = 0; i < n; i++)
+        {
+            t.in_count = i * 1000;
+            t.in_band  = i * 1000000;
+            out.str(std::string());
+            print_stats(out, tid('#', 0), t, t_, std::chrono::seconds(1));
+            keep(out);
+        }
+    }});
+
+    return ret;
+}
+
+
+static std::map<std::string, result>
+load_baseline(std::string const &file)
+{
+    std::ifstream in(file);
+    if (!in)
+        throw std::runtime_error(file + ": cannot open baseline");
+
+    std::map<std::string, result> ret;
+    result r;
+    while (in >> r.name >> r.ns >> r.cycles)
+        ret[r.name] = r;
+    return ret;
+}
+
+
+static void
+usage()
+{
+    std::cerr << "usage: captop_bench [--filter STRING] [--iterations N] [--len BYTES]\n"
+                 "                    [--save FILE] [--baseline FILE] [--threshold PCT]\n";
+    _Exit(0);
+}
+
+
+int
+main(int argc, char *argv[])
+try
+{
+    std::string filter, save, baseline;
+    size_t iterations = 0, len = 64;
+    double threshold = 10;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        auto value = [&] () -> const char * {
+            if (++i == argc)
+                throw std::runtime_error(std::string(argv[i-1]) + ": value missing");
+            return argv[i];
+        };
+
+        if (any_strcmp(argv[i], "--filter"))
+            filter = value();
+        else if (any_strcmp(argv[i], "--iterations"))
+            iterations = static_cast<size_t>(std::atoll(value()));
+        else if (any_strcmp(argv[i], "--len"))
+            len = std::min<size_t>(std::max<size_t>(std::atoi(value()), 60), 1514);
+        else if (any_strcmp(argv[i], "--save"))
+            save = value();
+        else if (any_strcmp(argv[i], "--baseline"))
+            baseline = value();
+        else if (any_strcmp(argv[i], "--threshold"))
+            threshold = std::atof(value());
+        else
+            usage();
+    }
+
+    // synthetic packets: the generator template with random addresses...
+    //
+
+    auto t = nulldev::synthesize(len, 4096, true);
+    auto dead = pcap_open_dead(DLT_EN10MB, 65535);
+
+    std::map<std::string, result> base;
+    if (!baseline.empty())
+        base = load_baseline(baseline);
+
+    tsc::cycles_per_ns();
+
+    std::vector<result> results;
+    int regressions = 0;
+
+    std::cout << std::left << std::setw(20) << "benchmark" << std::right << std::setw(12) << "ns/op"
+              << std::setw(12) << "cycles/op" << (base.empty() ? "" : "    vs baseline") << std::endl;
+
+    for(auto &b : benchmarks(t, dead))
+    {
+        if (!filter.empty() && b.name.find(filter) == std::string::npos)
+            continue;
+
+        auto r = measure(b, iterations);
+        results.push_back(r);
+
+        std::cout << std::left << std::setw(20) << r.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << r.ns << std::setw(12) << r.cycles;
+
+        auto it = base.find(r.name);
+        if (it != base.end() && it->second.ns > 0)
+        {
+            auto delta = 100.0 * (r.ns - it->second.ns) / it->second.ns;
+            std::cout << std::setw(10) << std::showpos << delta << std::noshowpos << '%';
+            if (delta > threshold) {
+                std::cout << "  " << highlight("REGRESSION");
+                regressions++;
+            }
+        }
+
+        std::cout << std::endl;
+    }
+
+    if (!save.empty())
+    {
+        std::ofstream out(save);
+        if (!out)
+            throw std::runtime_error(save + ": cannot write");
+        for(auto &r : results)
+            out << r.name << ' ' << r.ns << ' ' << r.cycles << '\n';
+    }
+
+    pcap_close(dead);
+    return regressions ? 1 : 0;
+}
+catch(std::exception &e)
+{
+    std::cerr << "captop_bench: " << e.what() << std::endl;
+    return 1;
+}
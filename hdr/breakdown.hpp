@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+#include <netinet/in.h>
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <packet.hpp>
+
+//
+// Traffic breakdown by ethertype, VLAN id and IP protocol, on the layers
+// parsed once per packet (see packet::parse). Ethertypes and protocols are
+// mapped to small class indexes through lookup tables, so that classifying
+// a packet is a handful of loads instead of a chain of comparisons.
+//
+
+namespace breakdown
+{
+    enum l3_class { l3_other, l3_ipv4, l3_ipv6, l3_arp, l3_mpls, l3_pppoe, l3_count };
+    enum l4_class { l4_none, l4_other, l4_tcp, l4_udp, l4_icmp, l4_sctp, l4_gre, l4_esp, l4_count };
+
+    const char * const l3_name[l3_count] = { "other", "ipv4", "ipv6", "arp", "mpls", "pppoe" };
+    const char * const l4_name[l4_count] = { "-", "other", "tcp", "udp", "icmp", "sctp", "gre", "esp" };
+
+    const size_t untagged  = 4096;
+    const size_t vlan_count = 4097;
+
+
+    struct tables
+    {
+        tables()
+        {
+            ethertype.fill(l3_other);
+            ethertype[0x0800] = l3_ipv4;
+            ethertype[0x86dd] = l3_ipv6;
+            ethertype[0x0806] = l3_arp;
+            ethertype[0x8847] = l3_mpls;
+            ethertype[0x8848] = l3_mpls;
+            ethertype[0x8863] = l3_pppoe;
+            ethertype[0x8864] = l3_pppoe;
+
+            proto.fill(l4_other);
+            proto[IPPROTO_TCP]    = l4_tcp;
+            proto[IPPROTO_UDP]    = l4_udp;
+            proto[IPPROTO_ICMP]   = l4_icmp;
+            proto[IPPROTO_ICMPV6] = l4_icmp;
+            proto[IPPROTO_SCTP]   = l4_sctp;
+            proto[IPPROTO_GRE]    = l4_gre;
+            proto[IPPROTO_ESP]    = l4_esp;
+        }
+
+        std::array<uint8_t, 65536>   ethertype;
+        std::array<uint8_t, 256>     proto;
+    };
+
+    inline tables const &
+    get_tables()
+    {
+        static const tables t;
+        return t;
+    }
+
+
+    struct counter
+    {
+        uint64_t packets;
+        uint64_t bytes;
+    };
+
+    struct snapshot
+    {
+        counter proto[l3_count][l4_count];
+        std::vector<counter> vlan;
+    };
+
+
+    //
+    // per-thread counters: single writer (relaxed load/store), read by
+    // the stats thread...
+    //
+
+    struct meter
+    {
+        struct atomic_counter
+        {
+            std::atomic<uint64_t> packets;
+            std::atomic<uint64_t> bytes;
+
+            void add(uint32_t len)
+            {
+                packets.store(packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                bytes.store(bytes.load(std::memory_order_relaxed) + len, std::memory_order_relaxed);
+            }
+
+            counter load() const
+            {
+                return { packets.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed) };
+            }
+        };
+
+        meter()
+        : tab(get_tables())
+        {
+            for(auto &row : proto)
+                for(auto &c : row)
+                    c.packets = 0, c.bytes = 0;
+            for(auto &c : vlan)
+                c.packets = 0, c.bytes = 0;
+        }
+
+        void account(captop_packet const &p, const struct pcap_pkthdr *h)
+        {
+            unsigned vid = p.nvlan ? p.vlan[0] : static_cast<unsigned>(untagged);
+            unsigned l3  = tab.ethertype[p.ethertype];
+            unsigned l4  = p.ip_version ? tab.proto[p.proto] : static_cast<unsigned>(l4_none);
+
+            proto[l3][l4].add(h->len);
+            vlan[vid].add(h->len);
+        }
+
+        // add the counters of this thread to s...
+        //
+
+        void read(snapshot &s) const
+        {
+            for(size_t i = 0; i < l3_count; i++)
+                for(size_t j = 0; j < l4_count; j++) {
+                    auto c = proto[i][j].load();
+                    s.proto[i][j].packets += c.packets;
+                    s.proto[i][j].bytes   += c.bytes;
+                }
+
+            for(size_t v = 0; v < vlan_count; v++) {
+                auto c = vlan[v].load();
+                s.vlan[v].packets += c.packets;
+                s.vlan[v].bytes   += c.bytes;
+            }
+        }
+
+        tables const &tab;
+        atomic_counter proto[l3_count][l4_count];
+        atomic_counter vlan[vlan_count];
+    };
+
+
+    inline void
+    clear(snapshot &s)
+    {
+        for(auto &row : s.proto)
+            for(auto &c : row)
+                c = counter{0, 0};
+        s.vlan.assign(vlan_count, counter{0, 0});
+    }
+}
@@ -0,0 +1,255 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+
+//
+// Microburst detection: capture threads account packets into fixed time
+// slots (by packet timestamp). Closed slots are pushed into a per-thread
+// single-producer/single-consumer ring that the stats thread drains and
+// merges at every interval. The slot still open when a thread goes quiet
+// is taken by the stats thread (request/ack handshake, as flows::meter).
+//
+
+namespace burst
+{
+    struct slot
+    {
+        uint64_t index;         // timestamp / slot length
+        uint64_t packets;
+        uint64_t bytes;
+    };
+
+
+    struct meter
+    {
+        meter(uint64_t slot_nsec, size_t capacity)
+        : nsec(slot_nsec)
+        , current{0, 0, 0}
+        , end(0)
+        , served(0)
+        , ring(capacity)
+        , mask(capacity - 1)
+        , head(0)
+        , pad_()
+        , tail(0)
+        , overflow(0)
+        , request(0)
+        , ack(0)
+        , taken(0)
+        {}
+
+        // capture thread...
+        //
+
+        void account(const struct pcap_pkthdr *h)
+        {
+            auto r = request.load(std::memory_order_relaxed);
+            if (__builtin_expect(r != served, 0))
+                answer(r);
+
+            auto ts = static_cast<uint64_t>(h->ts.tv_sec) * 1000000000 + h->ts.tv_usec * 1000;
+
+            if (__builtin_expect(ts >= end || ts < end - nsec, 0))
+            {
+                flush();
+                current.index = ts / nsec;
+                end = (current.index + 1) * nsec;
+            }
+
+            current.packets++;
+            current.bytes += h->len;
+        }
+
+        void flush()
+        {
+            if (current.packets == 0)
+                return;
+
+            auto h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) < ring.size()) {
+                ring[h & mask] = current;
+                head.store(h + 1, std::memory_order_release);
+            }
+            else {
+                overflow.store(overflow.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+
+            current.packets = 0;
+            current.bytes = 0;
+        }
+
+        // ack the request of the stats thread, unless it already took the
+        // open slot: then wait for it to be read and start a new one...
+        //
+
+        void answer(uint32_t r)
+        {
+            served = r;
+
+            auto a = r - 1;
+            if (ack.compare_exchange_strong(a, r, std::memory_order_acq_rel))
+                return;
+
+            while (taken.load(std::memory_order_acquire) != r)
+                std::this_thread::yield();
+
+            current.packets = 0;
+            current.bytes = 0;
+            end = 0;
+        }
+
+        // stats thread: the closed slots, and the open one if the capture
+        // thread does not answer within wait (it is idle)...
+        //
+
+        template <typename Fun>
+        void drain(Fun fun, std::chrono::microseconds wait)
+        {
+            auto r = request.load(std::memory_order_relaxed);
+            if (ack.load(std::memory_order_acquire) == r)
+                request.store(++r, std::memory_order_release);
+
+            auto until = std::chrono::steady_clock::now() + wait;
+            while (ack.load(std::memory_order_acquire) != r && std::chrono::steady_clock::now() <= until)
+                std::this_thread::yield();
+
+            auto t = tail.load(std::memory_order_relaxed);
+            auto h = head.load(std::memory_order_acquire);
+            for(; t != h; t++)
+                fun(ring[t & mask]);
+            tail.store(t, std::memory_order_release);
+
+            auto a = r - 1;
+            if (ack.compare_exchange_strong(a, r, std::memory_order_acq_rel))
+            {
+                if (current.packets)
+                    fun(current);
+                taken.store(r, std::memory_order_release);
+            }
+        }
+
+        const uint64_t nsec;
+
+        slot current;
+        uint64_t end;
+        uint32_t served;
+
+        std::vector<slot> ring;
+        const size_t mask;
+
+        // producer and consumer indexes on separate cache lines...
+        //
+
+        std::atomic<uint64_t> head;
+        char pad_[64];
+        std::atomic<uint64_t> tail;
+        std::atomic<uint64_t> overflow;
+
+        std::atomic<uint32_t> request;
+        std::atomic<uint32_t> ack;
+        std::atomic<uint32_t> taken;
+    };
+
+
+    //
+    // per-interval report, computed from the merged slots of all threads...
+    //
+
+    struct report
+    {
+        uint64_t slots;
+        uint64_t peak_packets;
+        uint64_t peak_bytes;
+        uint64_t bursts;
+        uint64_t worst_start;       // slot index of the worst burst
+        uint64_t worst_slots;
+        uint64_t worst_packets;
+    };
+
+
+    inline report
+    analyze(std::vector<slot> &slots, uint64_t threshold)
+    {
+        report r = {0, 0, 0, 0, 0, 0, 0};
+
+        std::sort(slots.begin(), slots.end(), [](slot const &a, slot const &b) { return a.index < b.index; });
+
+        // merge slots of different threads...
+        //
+
+        size_t n = 0;
+        for(size_t i = 0; i < slots.size(); i++)
+        {
+            if (n && slots[n-1].index == slots[i].index) {
+                slots[n-1].packets += slots[i].packets;
+                slots[n-1].bytes   += slots[i].bytes;
+            }
+            else
+                slots[n++] = slots[i];
+        }
+        slots.resize(n);
+
+        r.slots = n;
+
+        uint64_t start = 0, len = 0, pkts = 0;
+
+        auto close = [&] {
+            if (len == 0)
+                return;
+            r.bursts++;
+            if (pkts > r.worst_packets) {
+                r.worst_start   = start;
+                r.worst_slots   = len;
+                r.worst_packets = pkts;
+            }
+            len = pkts = 0;
+        };
+
+        for(auto &s : slots)
+        {
+            r.peak_packets = std::max(r.peak_packets, s.packets);
+            r.peak_bytes   = std::max(r.peak_bytes, s.bytes);
+
+            if (threshold && s.packets > threshold)
+            {
+                if (len && s.index != start + len)
+                    close();
+                if (len == 0)
+                    start = s.index;
+                len++;
+                pkts += s.packets;
+            }
+            else
+                close();
+        }
+
+        close();
+        return r;
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+
+#include <histogram.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Polling capture loop: pcap_dispatch on a non-blocking handle, with the
+// socket busy-polling the device queue (SO_BUSY_POLL, SO_PREFER_BUSY_POLL).
+// When idle the loop backs off from spinning to pause to poll(); the
+// wakeup latency (kernel timestamp to handler) of the first packet of
+// each batch and the share of idle iterations are kept per thread.
+//
+
+namespace busypoll
+{
+    struct stat
+    {
+        uint64_t loops;         // pcap_dispatch calls
+        uint64_t idle;          // ...that returned no packet
+        uint64_t sleeps;        // poll() calls
+    };
+
+
+    struct meter
+    {
+        meter()
+        : loops(0), idle(0), sleeps(0), wakeup()
+        {}
+
+        // capture thread...
+        //
+
+        void inc(std::atomic<uint64_t> &c)
+        {
+            c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        // stats thread...
+        //
+
+        operator stat() const
+        {
+            return { loops .load(std::memory_order_relaxed)
+                   , idle  .load(std::memory_order_relaxed)
+                   , sleeps.load(std::memory_order_relaxed) };
+        }
+
+        std::atomic<uint64_t> loops;
+        std::atomic<uint64_t> idle;
+        std::atomic<uint64_t> sleeps;
+
+        atomic_log_histogram<> wakeup;  // nsec
+    };
+
+
+    // enable busy polling on the handle (usec budget per syscall),
+    // returns false if the kernel refuses SO_PREFER_BUSY_POLL...
+    //
+
+    bool enable(pcap_t *p, int usec);
+
+    // capture until count packets (0: forever) or global::stop; timeout is
+    // the poll() timeout in msec once the loop has backed off...
+    //
+
+    void loop(pcap_t *p, size_t count, int timeout, pcap_handler handler, u_char *user, meter &m);
+}
@@ -23,9 +23,29 @@
 
 #include <atomic>
 #include <vector>
+#include <memory>
+
+#include <histogram.hpp>
+#include <packet.hpp>
+#include <probe.hpp>
+#include <burst.hpp>
+#include <flows.hpp>
+#include <breakdown.hpp>
+#include <sizes.hpp>
+#include <patterns.hpp>
+#include <ebpf.hpp>
+#include <busypoll.hpp>
+#include <ring.hpp>
+#include <flight.hpp>
+#include <nulldev.hpp>
 
 struct capthread
 {
+    capthread()
+    : id(0), iface(0), atomic_stat(), latency(), probe(), burst(), flows(), breakdown(), sizes(), patterns(), count(), busypoll(), ring(), flight(), replay(), layers(0), parsed(), handler(nullptr)
+    , in(nullptr), out(nullptr), pstat(nullptr), dumper(nullptr)
+    {}
+
     struct stat
     {
         unsigned long in_count;
@@ -36,12 +56,17 @@ struct capthread
     };
 
     int id;
+    size_t iface;               // thread group (-i)
 
     char errbuf[PCAP_ERRBUF_SIZE];
     char errbuf2[PCAP_ERRBUF_SIZE];
 
     struct atomic_stat
     {
+        atomic_stat()
+        : in_count(0), out_count(0), in_band(0), out_band(0), fail(0)
+        {}
+
         std::atomic_ulong in_count;
         std::atomic_ulong out_count;
         std::atomic_ulong in_band;
@@ -60,6 +85,38 @@ struct capthread
 
     } atomic_stat;
 
+    struct latency_stat
+    {
+        latency_stat(size_t s)
+        : sample(s), countdown(s)
+        {}
+
+        size_t sample;
+        size_t countdown;
+        atomic_log_histogram<> cycles;
+    };
+
+    std::unique_ptr<latency_stat> latency;
+    std::unique_ptr<probe::receiver> probe;
+    std::unique_ptr<burst::meter> burst;
+    std::unique_ptr<flows::meter> flows;
+    std::unique_ptr<breakdown::meter> breakdown;
+    std::unique_ptr<sizes::meter> sizes;
+    std::unique_ptr<patterns::meter> patterns;
+    std::unique_ptr<ebpf::count_filter> count;
+    std::unique_ptr<busypoll::meter> busypoll;
+    std::unique_ptr<ring::meter> ring;
+    std::unique_ptr<flight::recorder> flight;
+    std::unique_ptr<nulldev::trace> replay;     // null device
+
+    // layers parsed once per packet for the meters and the handler
+    // (0: none), see captop_parsed()...
+
+    int layers;
+    captop_packet parsed;
+
+    pcap_handler handler;
+
     pcap_t *in, *out;
 
     pcap_t *pstat;
@@ -1,14 +1,54 @@
 #pragma once
 
 #include <pcap/pcap.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+	/*
+	 * Packet layers, parsed once per packet by captop. Pointers refer to
+	 * the captured payload (no copies) and are NULL when the layer is not
+	 * present or not entirely captured. Ports are in host byte order.
+	 */
+
+	struct captop_packet
+	{
+		const u_char *l2;
+		const u_char *l3;
+		const u_char *l4;
+		const u_char *payload;
+
+		uint32_t payload_len;	/* captured bytes from payload */
+
+		uint16_t ethertype;	/* innermost */
+		uint16_t vlan[2];	/* VLAN ids, outer first */
+		uint8_t  nvlan;
+
+		uint8_t  layer;		/* highest layer parsed: 0, 2, 3 or 4 */
+		uint8_t  ip_version;	/* 0: not IP */
+		uint8_t  proto;		/* IPv4 protocol, IPv6 last next header */
+		uint8_t  fragment;	/* not the first fragment: no l4 */
+
+		uint16_t sport;
+		uint16_t dport;
+	};
+
 	void captop_handler(u_char *, const struct pcap_pkthdr *h, const u_char *payload);
 
+	/*
+	 * A handler (-H) gets the parsed layers of the current packet with
+	 * captop_parsed(user), after asking for them in its source with e.g.
+	 * CAPTOP_LAYERS(4). Returns NULL when no parsing was requested.
+	 */
+
+	const struct captop_packet *captop_parsed(const u_char *user);
+
 #ifdef __cplusplus
 }
+#define CAPTOP_LAYERS(n) extern "C" const int captop_layers = (n)
+#else
+#define CAPTOP_LAYERS(n) const int captop_layers = (n)
 #endif
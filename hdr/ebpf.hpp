@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Count-only capture: an eBPF socket filter, attached to a packet socket,
+// applies the filter and adds each matching packet to per-CPU counters
+// (total and per L4 protocol) kept in a BPF array map, then returns 0 so
+// that nothing is queued to the socket. The program is generated from
+// the expressions understood by the prefilter.
+//
+
+namespace ebpf
+{
+    enum slot { total, tcp, udp, icmp, other, slots };
+
+    const char * const slot_name[slots] = { "total", "tcp", "udp", "icmp", "other" };
+
+    struct counter
+    {
+        uint64_t packets;
+        uint64_t bytes;
+    };
+
+    struct counters
+    {
+        counter slot[slots];
+    };
+
+
+    struct count_filter
+    {
+        count_filter(std::string const &ifname, std::string const &filter);
+        ~count_filter();
+
+        count_filter(count_filter const &) = delete;
+        count_filter& operator=(count_filter const &) = delete;
+
+        // sum over the CPUs...
+        //
+
+        counters read() const;
+
+        int sock;
+        int map_fd;
+        int prog_fd;
+        size_t ncpu;
+    };
+}
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+//
+// Flight recorder: every capture thread keeps its most recent packets in
+// two preallocated segments used in turn (a full one and the one being
+// filled), so that at least one segment worth of bytes (or of seconds,
+// with a window) is always available, without any disk I/O.
+//
+// A trigger freezes the recorder: SIGUSR1 or a threshold of the stats
+// thread (served at the next packet of each thread), or a packet matching
+// the trigger expression (at once). The stats thread then writes the
+// frozen segments to a pcap file and hands them back empty; packets of the
+// meantime are not recorded.
+//
+
+namespace flight
+{
+    // generation of the global requests (signal, stats thresholds)...
+    //
+
+    extern std::atomic<uint64_t> requests;
+
+    void request(int = 0);
+
+    struct recorder
+    {
+        recorder(size_t bytes, uint64_t window_nsec, std::string const &match);
+        ~recorder();
+
+        recorder(recorder const &) = delete;
+        recorder& operator=(recorder const &) = delete;
+
+        // capture thread...
+        //
+
+        void record(const struct pcap_pkthdr *h, const u_char *pkt)
+        {
+            if (__builtin_expect(frozen.load(std::memory_order_acquire), 0))
+                return;
+
+            auto ts  = static_cast<uint64_t>(h->ts.tv_sec) * 1000000000 + h->ts.tv_usec * 1000;
+            auto len = std::min<size_t>(h->caplen, segment_size - sizeof(header));
+
+            auto s = &seg[active];
+            if (__builtin_expect(s->used + sizeof(header) + len > segment_size ||
+                                 (window && s->used && ts >= s->first + window), 0))
+            {
+                active ^= 1;
+                s = &seg[active];
+                s->used = 0;
+                s->packets = 0;
+            }
+
+            if (s->used == 0)
+                s->first = ts;
+
+            header x = { static_cast<uint32_t>(h->ts.tv_sec), static_cast<uint32_t>(h->ts.tv_usec),
+                         static_cast<uint32_t>(len), h->len };
+
+            memcpy(&s->data[s->used], &x, sizeof(x));
+            memcpy(&s->data[s->used + sizeof(x)], pkt, len);
+            s->used += sizeof(x) + len;
+            s->packets++;
+
+            if (__builtin_expect(requests.load(std::memory_order_relaxed) != seen, 0)) {
+                seen = requests.load(std::memory_order_relaxed);
+                frozen.store(true, std::memory_order_release);
+            }
+            else if (has_match && pcap_offline_filter(&match, h, pkt))
+                frozen.store(true, std::memory_order_release);
+        }
+
+        // stats thread, once frozen: write the packets (oldest first) to
+        // filename and resume recording with empty segments. Returns the
+        // number of packets written...
+        //
+
+        size_t dump(std::string const &filename);
+
+        struct header
+        {
+            uint32_t sec;
+            uint32_t usec;
+            uint32_t caplen;
+            uint32_t len;
+        };
+
+        struct segment
+        {
+            std::vector<u_char> data;
+            size_t used;
+            size_t packets;
+            uint64_t first;         // timestamp of the first packet (nsec)
+        };
+
+        const size_t segment_size;
+        const uint64_t window;      // nsec, 0: size only
+
+        segment seg[2];
+        unsigned int active;
+        uint64_t seen;
+
+        struct bpf_program match;
+        bool has_match;
+
+        int linktype;               // set by the capture thread before the start
+        size_t dumps;
+
+        std::atomic_bool frozen;
+    };
+}
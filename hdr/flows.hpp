@@ -0,0 +1,364 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <packet.hpp>
+
+//
+// Top talkers: every capture thread keeps a count-min sketch (packets and
+// bytes) and a bounded min-heap of the heaviest flows seen so far, indexed
+// by an open-addressing table. Memory is fixed regardless of the number
+// of flows. Tables are double-buffered: at each interval the stats thread
+// asks the capture thread to switch table, then merges and clears the
+// frozen one.
+//
+
+namespace flows
+{
+    struct key
+    {
+        uint8_t  src[16];
+        uint8_t  dst[16];
+        uint16_t sport;
+        uint16_t dport;
+        uint8_t  proto;
+        uint8_t  version;
+        uint8_t  pad[2];
+
+        bool operator==(key const &other) const
+        {
+            return memcmp(this, &other, sizeof(key)) == 0;
+        }
+    };
+
+    static_assert(sizeof(key) == 40, "flows::key: unexpected padding");
+
+
+    inline uint64_t hash(key const &k)
+    {
+        uint64_t w[sizeof(key)/8];
+        memcpy(w, &k, sizeof(key));
+
+        uint64_t h = 0x9e3779b97f4a7c15ull;
+        for(auto x : w) {
+            h ^= x;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        return h;
+    }
+
+
+    //
+    // flow key of an IP packet (see packet::parse). Returns false for
+    // non-IP packets.
+    //
+
+    inline bool make_key(captop_packet const &p, key &k)
+    {
+        if (p.layer < packet::l3)
+            return false;
+
+        memset(&k, 0, sizeof(k));
+
+        k.version = p.ip_version;
+        k.proto   = p.proto;
+        k.sport   = p.sport;
+        k.dport   = p.dport;
+
+        if (p.ip_version == 4) {
+            memcpy(k.src, p.l3 + 12, 4);
+            memcpy(k.dst, p.l3 + 16, 4);
+        }
+        else {
+            memcpy(k.src, p.l3 + 8, 16);
+            memcpy(k.dst, p.l3 + 24, 16);
+        }
+
+        return true;
+    }
+
+
+    struct entry
+    {
+        key      k;
+        uint64_t packets;
+        uint64_t bytes;
+        uint32_t slot;          // position in the index
+    };
+
+
+    struct table
+    {
+        static constexpr size_t depth = 4;
+        static constexpr size_t width = 1 << 14;
+
+        table(size_t k)
+        : packets(depth * width)
+        , bytes(depth * width)
+        , heap()
+        , index()
+        , capacity(k)
+        {
+            size_t n = 1;
+            while (n < 2 * k)
+                n <<= 1;
+            index.assign(n, -1);
+            heap.reserve(k);
+        }
+
+        void account(key const &k, uint64_t h, uint32_t len)
+        {
+            // count-min sketch...
+            //
+
+            uint64_t est_p = ~0ull, est_b = ~0ull;
+            auto h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32) | 1;
+
+            for(size_t d = 0; d < depth; d++)
+            {
+                auto i = d * width + ((h1 + d * h2) & (width - 1));
+                est_p = std::min<uint64_t>(est_p, ++packets[i]);
+                est_b = std::min<uint64_t>(est_b, bytes[i] += len);
+            }
+
+            // heavy hitters...
+            //
+
+            auto mask = index.size() - 1;
+            auto slot = h & mask;
+
+            for(; index[slot] != -1; slot = (slot + 1) & mask)
+            {
+                auto &e = heap[index[slot]];
+                if (e.k == k) {
+                    e.packets = est_p;
+                    e.bytes   = est_b;
+                    sift_down(index[slot]);
+                    return;
+                }
+            }
+
+            if (heap.size() < capacity)
+            {
+                heap.push_back(entry{k, est_p, est_b, static_cast<uint32_t>(slot)});
+                index[slot] = heap.size() - 1;
+                sift_up(heap.size() - 1);
+                return;
+            }
+
+            if (est_p <= heap[0].packets)
+                return;
+
+            // replace the lightest flow...
+            //
+
+            erase_slot(heap[0].slot);
+
+            slot = h & mask;
+            while (index[slot] != -1)
+                slot = (slot + 1) & mask;
+
+            heap[0] = entry{k, est_p, est_b, static_cast<uint32_t>(slot)};
+            index[slot] = 0;
+            sift_down(0);
+        }
+
+        void clear()
+        {
+            std::fill(packets.begin(), packets.end(), 0);
+            std::fill(bytes.begin(), bytes.end(), 0);
+            std::fill(index.begin(), index.end(), -1);
+            heap.clear();
+        }
+
+        std::vector<uint32_t> packets;
+        std::vector<uint64_t> bytes;
+        std::vector<entry>    heap;         // min-heap on packets
+        std::vector<int32_t>  index;        // open addressing, linear probing
+        size_t capacity;
+
+    private:
+
+        void place(size_t pos)
+        {
+            index[heap[pos].slot] = pos;
+        }
+
+        void sift_up(size_t pos)
+        {
+            while (pos > 0)
+            {
+                auto parent = (pos - 1) / 2;
+                if (heap[parent].packets <= heap[pos].packets)
+                    break;
+                std::swap(heap[parent], heap[pos]);
+                place(parent);
+                place(pos);
+                pos = parent;
+            }
+        }
+
+        void sift_down(size_t pos)
+        {
+            for(;;)
+            {
+                auto l = 2 * pos + 1, r = l + 1, m = pos;
+                if (l < heap.size() && heap[l].packets < heap[m].packets)
+                    m = l;
+                if (r < heap.size() && heap[r].packets < heap[m].packets)
+                    m = r;
+                if (m == pos)
+                    break;
+                std::swap(heap[m], heap[pos]);
+                place(m);
+                place(pos);
+                pos = m;
+            }
+        }
+
+        // backward-shift deletion (keeps probe sequences intact)...
+        //
+
+        void erase_slot(size_t slot)
+        {
+            auto mask = index.size() - 1;
+            index[slot] = -1;
+
+            for(auto next = (slot + 1) & mask; index[next] != -1; next = (next + 1) & mask)
+            {
+                auto home = hash(heap[index[next]].k) & mask;
+                if (((next - home) & mask) >= ((next - slot) & mask))
+                {
+                    index[slot] = index[next];
+                    heap[index[slot]].slot = slot;
+                    index[next] = -1;
+                    slot = next;
+                }
+            }
+        }
+    };
+
+
+    struct meter
+    {
+        meter(size_t k)
+        : tables{{ table(k), table(k) }}
+        , current(0)
+        , request(0)
+        , ack(0)
+        , taken(0)
+        {}
+
+        // capture thread: switch tables on request, unless the stats
+        // thread already did it for an idle thread (then wait for it to
+        // be done with the old table)...
+        //
+
+        void account(captop_packet const &p, const struct pcap_pkthdr *h)
+        {
+            auto r = request.load(std::memory_order_relaxed);
+            if (__builtin_expect(r != current, 0))
+            {
+                auto a = r - 1;
+                if (!ack.compare_exchange_strong(a, r, std::memory_order_acq_rel))
+                    while (taken.load(std::memory_order_acquire) != r)
+                        std::this_thread::yield();
+                current = r;
+            }
+
+            key k;
+            if (make_key(p, k))
+                tables[current & 1].account(k, hash(k), h->len);
+        }
+
+        // stats thread: switch tables (waiting a little for the capture
+        // thread, taking the switch over if it is idle) and hand the
+        // frozen one to fun, then clear it...
+        //
+
+        template <typename Fun>
+        void collect(Fun fun, std::chrono::microseconds wait)
+        {
+            auto r = request.load(std::memory_order_relaxed);
+            if (ack.load(std::memory_order_acquire) == r)
+                request.store(++r, std::memory_order_release);
+
+            auto until = std::chrono::steady_clock::now() + wait;
+            while (ack.load(std::memory_order_acquire) != r && std::chrono::steady_clock::now() <= until)
+                std::this_thread::yield();
+
+            auto a = r - 1;
+            bool idle = ack.compare_exchange_strong(a, r, std::memory_order_acq_rel);
+
+            auto &t = tables[(r + 1) & 1];
+            fun(t);
+            t.clear();
+
+            if (idle)
+                taken.store(r, std::memory_order_release);
+        }
+
+        std::array<table, 2> tables;
+        uint32_t current;
+
+        std::atomic<uint32_t> request;
+        std::atomic<uint32_t> ack;
+        std::atomic<uint32_t> taken;
+    };
+
+
+    //
+    // merge the heavy hitters collected from all threads (the same flow
+    // may be seen by more than one thread)...
+    //
+
+    inline void
+    merge(std::vector<entry> &flows)
+    {
+        std::sort(flows.begin(), flows.end(), [](entry const &a, entry const &b) {
+            return memcmp(&a.k, &b.k, sizeof(key)) < 0;
+        });
+
+        size_t n = 0;
+        for(size_t i = 0; i < flows.size(); i++)
+        {
+            if (n && flows[n-1].k == flows[i].k) {
+                flows[n-1].packets += flows[i].packets;
+                flows[n-1].bytes   += flows[i].bytes;
+            }
+            else
+                flows[n++] = flows[i];
+        }
+        flows.resize(n);
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#pragma once
+
+#include <netinet/ip.h>
+
+#include <random>
+#include <cstdint>
+#include <cstring>
+
+#include <global.hpp>
+#include <probe.hpp>
+
+//
+// The frames of the generator: a private copy of the default packet with
+// random addresses (--rand-ip) and a probe stamp (--probe) rewritten for
+// every frame sent...
+//
+
+namespace generator
+{
+    struct frame
+    {
+        frame(bool rand_ip, bool probe, uint32_t stream)
+        : rand_ip(rand_ip), probe(probe), stream(stream), gen()
+        {
+            memcpy(data, global::default_packet, sizeof(data));
+        }
+
+        const unsigned char *
+        next(uint64_t seq)
+        {
+            if (rand_ip)
+            {
+                auto ip = reinterpret_cast<iphdr *>(data + 14);
+                ip->saddr = static_cast<uint32_t>(gen());
+                ip->daddr = static_cast<uint32_t>(gen());
+            }
+
+            if (probe)
+                probe::stamp(data, stream, seq);
+
+            return data;
+        }
+
+        bool rand_ip;
+        bool probe;
+        uint32_t stream;
+        std::mt19937 gen;
+        unsigned char data[1514];
+    };
+}
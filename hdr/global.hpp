@@ -37,8 +37,29 @@ namespace global
 
     extern std::vector<std::unique_ptr<capthread>> thread_ctx;
     extern std::vector<std::thread> thread;
+    extern std::vector<size_t> cores;
 
     extern std::atomic_bool stop;
 
     extern std::mutex syncout;
+
+    // pcap_stats accumulates into the handle: one reader at a time...
+    //
+
+    extern std::mutex syncstats;
+
+    // start barrier: every thread arrives once set up (handle activated,
+    // filter and handler loaded) and waits; pcap_top releases them all
+    // together...
+    //
+
+    extern std::atomic<size_t> ready;
+    extern std::atomic_bool start;
+
+    inline void arrive()
+    {
+        ready.fetch_add(1, std::memory_order_release);
+        while (!start.load(std::memory_order_acquire) && !stop.load(std::memory_order_relaxed))
+            std::this_thread::yield();
+    }
 }
@@ -21,5 +21,7 @@
 
 #include <pcap/pcap.h>
 #include <options.hpp>
+#include <capthread.hpp>
 
-extern pcap_handler get_packet_handler(options const &);
+extern pcap_handler get_packet_handler(options const &, capthread *);
+extern pcap_handler instrument_handler(options const &, capthread *, pcap_handler);
@@ -0,0 +1,167 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+//
+// Log-linear (HDR-style) histogram: values below 2^SubBits have their own
+// bucket, every power-of-two range above is split into 2^SubBits linear
+// sub-buckets (relative error < 2^-SubBits). Values >= 2^MaxBits are
+// clamped into the last bucket.
+//
+
+template <unsigned SubBits = 5, unsigned MaxBits = 40>
+struct log_histogram
+{
+    static constexpr size_t sub_count    = size_t(1) << SubBits;
+    static constexpr size_t bucket_count = (MaxBits - SubBits + 1) * sub_count;
+
+    static size_t index(uint64_t value)
+    {
+        if (value < sub_count)
+            return value;
+
+        unsigned msb = 63 - __builtin_clzll(value);
+        if (msb >= MaxBits)
+            return bucket_count - 1;
+
+        auto group = msb - SubBits;
+        return sub_count * (group + 1) + ((value >> group) - sub_count);
+    }
+
+    // highest value that maps into the bucket...
+    //
+
+    static uint64_t value(size_t idx)
+    {
+        if (idx < sub_count)
+            return idx;
+
+        auto group = idx / sub_count - 1;
+        auto sub   = idx % sub_count;
+        return ((sub_count + sub + 1) << group) - 1;
+    }
+
+    uint64_t total() const
+    {
+        uint64_t n = 0;
+        for(auto c : count)
+            n += c;
+        return n;
+    }
+
+    uint64_t percentile(double p) const
+    {
+        auto n = total();
+        if (n == 0)
+            return 0;
+
+        auto rank = static_cast<uint64_t>(p / 100.0 * n + 0.5);
+        if (rank == 0)
+            rank = 1;
+
+        uint64_t acc = 0;
+        for(size_t i = 0; i < bucket_count; i++)
+        {
+            acc += count[i];
+            if (acc >= rank)
+                return std::min(value(i), max);
+        }
+        return max;
+    }
+
+    log_histogram &
+    operator+=(log_histogram const &other)
+    {
+        for(size_t i = 0; i < bucket_count; i++)
+            count[i] += other.count[i];
+        max = std::max(max, other.max);
+        return *this;
+    }
+
+    std::array<uint64_t, bucket_count> count;
+    uint64_t max;
+};
+
+
+template <unsigned SubBits, unsigned MaxBits>
+inline log_histogram<SubBits, MaxBits>
+operator-(log_histogram<SubBits, MaxBits> const &lhs, log_histogram<SubBits, MaxBits> const &rhs)
+{
+    log_histogram<SubBits, MaxBits> ret;
+    for(size_t i = 0; i < ret.bucket_count; i++)
+        ret.count[i] = lhs.count[i] - rhs.count[i];
+    ret.max = lhs.max;
+    return ret;
+}
+
+
+//
+// Single-writer histogram shared with the stats thread: the owner updates
+// buckets with relaxed load/store (no locked instructions), readers take a
+// snapshot by converting it into a log_histogram.
+//
+
+template <unsigned SubBits = 5, unsigned MaxBits = 40>
+struct atomic_log_histogram
+{
+    using histogram = log_histogram<SubBits, MaxBits>;
+
+    atomic_log_histogram()
+    {
+        for(auto &c : count)
+            c.store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t value)
+    {
+        auto &c = count[histogram::index(value)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (value > max.load(std::memory_order_relaxed))
+            max.store(value, std::memory_order_relaxed);
+    }
+
+    // max since the previous call (owned by the reader)...
+    //
+
+    uint64_t reset_max()
+    {
+        return max.exchange(0, std::memory_order_relaxed);
+    }
+
+    operator histogram() const
+    {
+        histogram h;
+        for(size_t i = 0; i < histogram::bucket_count; i++)
+            h.count[i] = count[i].load(std::memory_order_relaxed);
+        h.max = max.load(std::memory_order_relaxed);
+        return h;
+    }
+
+    std::array<std::atomic<uint64_t>, histogram::bucket_count> count;
+    std::atomic<uint64_t> max;
+};
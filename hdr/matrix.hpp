@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <options.hpp>
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//
+// Benchmark matrix: every combination of the capture parameters of a
+// spec such as "thread=1,2,4;buffer=1M,8M;immediate=0,1" runs in a child
+// process (fresh threads and counters) for a fixed window, then the
+// results are ranked by pps per core and drop rate.
+//
+
+namespace matrix
+{
+    struct axis
+    {
+        std::string name;       // thread, buffer, snaplen, timeout, immediate, fanout
+        std::vector<std::string> values;
+    };
+
+    std::vector<axis> parse(std::string const &spec);
+
+    // set one parameter of a trial...
+    //
+
+    void apply(options &opt, std::string const &name, std::string const &value);
+
+    struct result
+    {
+        std::string label;
+        size_t threads;
+        bool ok;
+        double pps;
+        double bps;
+        double drop;            // percent of the packets seen by the kernel
+    };
+
+    int run(options const &opt, std::string const &filter);
+}
@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//
+// Null device: packets preloaded in memory (from a trace or from the
+// generator template) and replayed in a loop into the handler, so the
+// cost of captop itself can be measured without kernel and NIC.
+//
+
+namespace nulldev
+{
+    struct trace
+    {
+        std::vector<struct pcap_pkthdr> hdr;
+        std::vector<size_t> offset;
+        std::vector<u_char> data;
+
+        size_t size() const
+        {
+            return hdr.size();
+        }
+
+        void push(struct pcap_pkthdr const &h, const u_char *pkt);
+    };
+
+    // the packets of a file that match the filter (up to limit bytes)...
+    //
+
+    trace load(std::string const &filename, std::string const &filter, bool optimize, size_t limit);
+
+    // n copies of the template of len bytes, with random addresses if
+    // rand_ip (fixed seed: the same packets at every run)...
+    //
+
+    trace synthesize(size_t len, size_t n, bool rand_ip);
+}
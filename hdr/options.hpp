@@ -32,7 +32,13 @@ struct options
     size_t snaplen;
     size_t timeout;
     size_t numthread;
-    size_t firstcore;
+    size_t firstcore;   // ~0: not given, threads are placed
+    size_t latency;
+    size_t interval;    // usec
+    size_t top;
+    size_t busy_poll;   // usec
+    size_t warmup;      // usec
+    size_t duration;    // usec, 0: until the end of the capture
 
     uint32_t genlen;
 
@@ -41,6 +47,13 @@ struct options
     bool   next;
     bool   immediate;
     bool   nonblock;
+    bool   probe;
+    bool   breakdown;
+    bool   prefilter;
+    bool   count_only;
+    bool   rx_queues;
+    bool   bridge;
+    bool   null_device;
 
     struct
     {
@@ -54,12 +67,78 @@ struct options
         std::string filename;
     } out;
 
+    // further -i: each interface has its own thread group (the first one
+    // is described by in.ifname, numthread, cores, fanout)...
+    //
+
+    struct interface
+    {
+        std::string ifname;
+        size_t numthread;
+        std::vector<size_t> cores;
+        std::string bpf;        // empty: the BPF expression of the command line
+#ifdef PCAP_VERSION_FANOUT
+        int group;
+        std::string fanout;
+#endif
+    };
+
+    std::vector<interface> interfaces;
+
     std::string handler;
     std::string compiler;
     std::vector<std::string> arguments;
+    std::vector<size_t> cores;
 
     range_filter rfilt;
 
+    std::string sizes;          // frame size buckets: rfc, fine
+    std::string patterns;       // payload search, one pattern per line
+
+    struct
+    {
+        std::string format;     // json, csv
+        std::string file;
+        std::string shm;        // POSIX shared-memory segment name
+    } stats;
+
+    struct
+    {
+        size_t size;            // raw samples kept
+        std::string file;
+    } series;
+
+    struct
+    {
+        size_t slot;            // usec
+        size_t threshold;       // pps
+    } burst;
+
+    struct
+    {
+        std::string sizes;      // frame sizes, empty: no sweep
+        double trial;           // sec
+        double warmup;          // sec
+        double loss;            // percent
+        size_t rate;            // pps, 0: generator maximum
+    } sweep;
+
+    struct
+    {
+        std::string spec;       // "thread=1,2;buffer=1M,8M", empty: no matrix
+        double window;          // sec
+    } matrix;
+
+    struct
+    {
+        size_t size;            // bytes per thread, 0: no flight recorder
+        double window;          // sec, 0: size only
+        std::string file;       // prefix of the dumps
+        std::string match;      // BPF expression, empty: no match trigger
+        size_t pps;             // trigger above pps, 0: none
+        size_t drop;            // trigger above drops/sec, 0: none
+    } flight;
+
 #ifdef PCAP_VERSION_FANOUT
     int group;
     std::string fanout;
@@ -76,6 +155,12 @@ namespace
         65535,
         10,
         1,
+        ~size_t(0),
+        0,
+        1000000,
+        0,
+        0,
+        1000000,
         0,
         1514,
         true,
@@ -83,12 +168,29 @@ namespace
         false,
         false,
         false,
+        false,
+        false,
+        true,
+        false,
+        false,
+        false,
+        false,
         { "", "" },
         { "", "" },
         {},
         {},
         {},
+        {},
+        {},
+        "",
+        "",
         "",
+        { "", "", "" },
+        { 86400, "" },
+        { 0, 0 },
+        { "", 10, 2, 0, 0 },
+        { "", 10 },
+        { 0, 0, "flight", "", 0, 0 },
 #ifdef PCAP_VERSION_FANOUT
         0,
         {}
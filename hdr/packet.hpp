@@ -0,0 +1,194 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <cstddef>
+
+#include <captop.h>
+
+//
+// Zero-copy L2-L4 parser: ethernet (up to two VLAN tags), IPv4, IPv6 (and
+// its extension headers) and TCP/UDP. The deepest layer is a template argument, so that the checks of
+// the layers not asked for are compiled out. Every access is bounded by
+// caplen; nothing is allocated or copied.
+//
+
+namespace packet
+{
+    enum layer { l2 = 2, l3 = 3, l4 = 4 };
+
+    inline uint16_t
+    load16(const u_char *p)
+    {
+        return static_cast<uint16_t>(p[0] << 8 | p[1]);
+    }
+
+
+    // the IPv6 extension headers walked to find the upper-layer protocol...
+    //
+
+    inline bool
+    extension(uint8_t nh)
+    {
+        return nh == IPPROTO_HOPOPTS || nh == IPPROTO_ROUTING || nh == IPPROTO_FRAGMENT ||
+               nh == IPPROTO_AH      || nh == IPPROTO_DSTOPTS;
+    }
+
+
+    template <int Layer>
+    inline int parse(const u_char *pkt, size_t caplen, captop_packet &p)
+    {
+        static_assert(Layer >= l2 && Layer <= l4, "packet::parse: layer must be 2, 3 or 4");
+
+        p.l2 = p.l3 = p.l4 = p.payload = nullptr;
+        p.payload_len = 0;
+        p.ethertype   = 0;
+        p.vlan[0]     = p.vlan[1] = 0;
+        p.nvlan       = 0;
+        p.layer       = 0;
+        p.ip_version  = 0;
+        p.proto       = 0;
+        p.fragment    = 0;
+        p.sport       = p.dport = 0;
+
+        // ethernet and VLAN tags...
+        //
+
+        if (caplen < 14)
+            return 0;
+
+        p.l2    = pkt;
+        p.layer = l2;
+
+        size_t off = 12;
+
+        p.ethertype = load16(pkt + off);
+        while (p.nvlan < 2 && (p.ethertype == 0x8100 || p.ethertype == 0x88a8))
+        {
+            if (caplen < off + 8)
+                return p.layer;
+            p.vlan[p.nvlan++] = load16(pkt + off + 2) & 0xfff;
+            off += 4;
+            p.ethertype = load16(pkt + off);
+        }
+
+        off += 2;
+
+        if (Layer < l3)
+            return p.layer;
+
+        // IPv4, IPv6...
+        //
+
+        size_t next;
+
+        if (p.ethertype == 0x0800)
+        {
+            if (caplen < off + 20)
+                return p.layer;
+
+            size_t ihl = (pkt[off] & 0xf) * 4u;
+            if (ihl < 20 || caplen < off + ihl)
+                return p.layer;
+
+            p.ip_version = 4;
+            p.proto      = pkt[off + 9];
+            p.fragment   = ((pkt[off + 6] & 0x1f) | pkt[off + 7]) != 0;
+            next         = off + ihl;
+        }
+        else if (p.ethertype == 0x86dd)
+        {
+            if (caplen < off + 40)
+                return p.layer;
+
+            p.ip_version = 6;
+            p.proto      = pkt[off + 6];
+            next         = off + 40;
+
+            // extension headers, as long as they are captured (each one is
+            // at least 8 bytes long)...
+            //
+
+            while (extension(p.proto) && caplen >= next + 8)
+            {
+                auto h = pkt + next;
+                if (p.proto == IPPROTO_FRAGMENT) {
+                    p.fragment = (load16(h + 2) & 0xfff8) != 0;
+                    next += 8;
+                }
+                else if (p.proto == IPPROTO_AH)
+                    next += (h[1] + 2) * 4u;
+                else
+                    next += (h[1] + 1) * 8u;
+                p.proto = h[0];
+            }
+        }
+        else
+            return p.layer;
+
+        p.l3    = pkt + off;
+        p.layer = l3;
+
+        if (Layer < l4 || p.fragment || next > caplen || extension(p.proto) || p.proto == IPPROTO_NONE)
+            return p.layer;
+
+        // transport: ports are read as soon as they are captured...
+        //
+
+        size_t hlen;
+
+        switch(p.proto)
+        {
+        case IPPROTO_TCP:
+            hlen = caplen >= next + 20 ? (pkt[next + 12] >> 4) * 4u : 0;
+            if (hlen < 20)
+                hlen = 0;
+            break;
+        case IPPROTO_UDP:
+            hlen = caplen >= next + 8 ? 8 : 0;
+            break;
+        default:
+            if (next < caplen) {
+                p.l4    = pkt + next;
+                p.layer = l4;
+            }
+            return p.layer;
+        }
+
+        if (caplen >= next + 4) {
+            p.sport = load16(pkt + next);
+            p.dport = load16(pkt + next + 2);
+        }
+
+        if (hlen == 0 || next + hlen > caplen)
+            return p.layer;
+
+        p.l4          = pkt + next;
+        p.layer       = l4;
+        p.payload     = pkt + next + hlen;
+        p.payload_len = static_cast<uint32_t>(caplen - next - hlen);
+
+        return p.layer;
+    }
+}
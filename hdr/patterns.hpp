@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Multi-pattern payload search, to measure the cost of content inspection.
+//
+// The matcher is a Teddy-like filter: patterns are spread over 8 buckets
+// and the first two bytes of each pattern are encoded in nibble tables, so
+// that 16 or 32 positions are tested at once with a few shuffles (SSSE3,
+// AVX2) and only the buckets flagged at a position are verified. A scalar
+// loop with the same tables handles the tail and the builds without SIMD.
+//
+
+namespace patterns
+{
+    // one pattern per line; empty lines and lines starting with '#' are
+    // skipped, \xHH and \\ are unescaped...
+    //
+
+    std::vector<std::string> load(std::string const &filename);
+
+    std::string printable(std::string const &pattern);
+
+    const char *isa();
+
+
+    struct matcher
+    {
+        static constexpr size_t buckets = 8;
+
+        matcher(std::vector<std::string> const &pats);
+
+        std::vector<std::string> pats;
+        std::array<std::vector<uint32_t>, buckets> bucket;
+
+        // nibble tables: bit b set if a pattern of bucket b has that
+        // low/high nibble as first (1) or second (2) byte...
+
+        alignas(16) uint8_t lo1[16], hi1[16], lo2[16], hi2[16];
+    };
+
+
+    //
+    // per-thread counters: single writer (relaxed load/store), read by
+    // the stats thread...
+    //
+
+    struct meter
+    {
+        struct snapshot
+        {
+            uint64_t packets;
+            uint64_t bytes;
+            std::vector<uint64_t> hits;
+        };
+
+        meter(std::vector<std::string> const &pats);
+
+        void account(const u_char *data, size_t len);
+
+        // add the counters of this thread to s...
+        //
+
+        void read(snapshot &s) const;
+
+        matcher m;
+
+        std::atomic<uint64_t> packets;
+        std::atomic<uint64_t> bytes;
+        std::unique_ptr<std::atomic<uint64_t>[]> hits;
+    };
+}
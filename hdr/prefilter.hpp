@@ -0,0 +1,183 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Prefilter for the common BPF expressions: a conjunction of ip, ip6, tcp,
+// udp, icmp, sctp, [src|dst] host A.B.C.D, [src|dst] net A.B.C.D/LEN and
+// [src|dst] port NUM. Anything else (or, not, names, ranges...) is left
+// to the compiled BPF program.
+//
+// The fields the expression may test are extracted from a batch of
+// packets into arrays (one per field), then every term is evaluated over
+// the whole batch with branch-free loops the compiler vectorizes. Offsets
+// are those of the BPF code generated for ethernet: VLAN tags are not
+// skipped, short packets do not match.
+//
+
+namespace prefilter
+{
+    enum dir { either, source, destination };
+
+    struct address
+    {
+        dir      d;
+        uint32_t net;           // host order
+        uint32_t mask;
+    };
+
+    struct port
+    {
+        dir      d;
+        uint32_t value;
+    };
+
+    struct program
+    {
+        unsigned l3;                    // 0: any, 4 or 6
+        std::vector<uint32_t> protos;   // any of (empty: any)
+        std::vector<address> addrs;     // all of
+        std::vector<port> ports;        // all of
+    };
+
+    // false if the expression is not one of the simple forms...
+    //
+
+    bool compile(std::string const &filter, program &prog);
+
+    std::string to_string(program const &prog);
+
+
+    const uint32_t none   = 0x10000;        // field not present
+    const uint64_t absent = 1ull << 32;
+
+
+    struct batch
+    {
+        static constexpr size_t size = 64;
+
+        // each field is present only if captured, as BPF rejects a packet
+        // on a load past caplen...
+        //
+
+        void extract(size_t i, const u_char *pkt, size_t caplen)
+        {
+            l3[i]    = 0;
+            proto[i] = proto2[i] = sport[i] = dport[i] = none;
+            src[i]   = dst[i] = absent;
+
+            if (caplen < 14)
+                return;
+
+            auto type = pkt[12] << 8 | pkt[13];
+
+            if (type == 0x0800)
+            {
+                l3[i] = 4;
+                if (caplen >= 24)
+                    proto[i] = pkt[23];
+                if (caplen >= 30)
+                    src[i] = static_cast<uint32_t>(pkt[26]) << 24 | pkt[27] << 16 | pkt[28] << 8 | pkt[29];
+                if (caplen >= 34)
+                    dst[i] = static_cast<uint32_t>(pkt[30]) << 24 | pkt[31] << 16 | pkt[32] << 8 | pkt[33];
+
+                // ports of the first fragment only...
+                if (caplen >= 34 && ((pkt[20] & 0x1f) | pkt[21]) == 0)
+                    ports(i, 14 + (pkt[14] & 0xf) * 4u, pkt, caplen);
+            }
+            else if (type == 0x86dd)
+            {
+                l3[i] = 6;
+                if (caplen >= 21)
+                    proto[i] = pkt[20];
+
+                // the nexthdr of a fragment header counts as protocol...
+                if (proto[i] == 44 && caplen >= 55)
+                    proto2[i] = pkt[54];
+
+                ports(i, 54, pkt, caplen);
+            }
+        }
+
+        void ports(size_t i, size_t off, const u_char *pkt, size_t caplen)
+        {
+            if (proto[i] != 6 && proto[i] != 17 && proto[i] != 132)
+                return;
+            if (caplen >= off + 2)
+                sport[i] = static_cast<uint32_t>(pkt[off] << 8 | pkt[off+1]);
+            if (caplen >= off + 4)
+                dport[i] = static_cast<uint32_t>(pkt[off+2] << 8 | pkt[off+3]);
+        }
+
+        // evaluate prog on the first n packets: match[i] != 0...
+        //
+
+        void eval(program const &prog, size_t n)
+        {
+            for(size_t i = 0; i < n; i++)
+                match[i] = 1;
+
+            if (prog.l3)
+                for(size_t i = 0; i < n; i++)
+                    match[i] &= l3[i] == prog.l3;
+
+            if (!prog.protos.empty())
+            {
+                uint32_t p[3] = { ~0u, ~0u, ~0u };     // never equal to a field
+                for(size_t k = 0; k < prog.protos.size() && k < 3; k++)
+                    p[k] = prog.protos[k];
+
+                for(size_t i = 0; i < n; i++)
+                    match[i] &= (proto[i]  == p[0]) | (proto[i]  == p[1]) | (proto[i]  == p[2]) |
+                                (proto2[i] == p[0]) | (proto2[i] == p[1]) | (proto2[i] == p[2]);
+            }
+
+            for(auto &a : prog.addrs)
+            {
+                uint64_t s = a.d != destination, d = a.d != source, mask = a.mask | absent;
+                for(size_t i = 0; i < n; i++)
+                    match[i] &= (l3[i] == 4) & ((s & ((src[i] & mask) == a.net)) | (d & ((dst[i] & mask) == a.net)));
+            }
+
+            for(auto &pt : prog.ports)
+            {
+                uint32_t s = pt.d != destination, d = pt.d != source;
+                for(size_t i = 0; i < n; i++)
+                    match[i] &= (s & (sport[i] == pt.value)) | (d & (dport[i] == pt.value));
+            }
+        }
+
+        uint32_t l3[size];
+        uint32_t proto[size];
+        uint32_t proto2[size];
+        uint64_t src[size];             // host order, absent if not captured
+        uint64_t dst[size];
+        uint32_t sport[size];
+        uint32_t dport[size];
+        uint32_t match[size];
+    };
+}
@@ -0,0 +1,169 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <time.h>
+
+#include <atomic>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+
+#include <histogram.hpp>
+
+//
+// Probe packets: the generator stamps a stream id, a sequence number and a
+// CLOCK_MONOTONIC timestamp into the payload (right after the eth/ip/icmp
+// headers of the default packet); the receiver decodes them and keeps
+// per-stream latency, loss, duplicate and reordering counters.
+//
+
+namespace probe
+{
+    const uint32_t magic       = 0xca97097f;
+    const size_t   offset      = 14 + 20 + 8;
+    const size_t   max_streams = 64;
+
+    struct payload
+    {
+        uint32_t magic;
+        uint32_t stream;
+        uint64_t seq;
+        uint64_t tstamp;
+    } __attribute__((packed));
+
+    const size_t min_len = offset + sizeof(payload);
+
+    inline uint64_t now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    inline void stamp(unsigned char *pkt, uint32_t stream, uint64_t seq)
+    {
+        payload p = { magic, stream, seq, now() };
+        memcpy(pkt + offset, &p, sizeof(p));
+    }
+
+    inline bool decode(const unsigned char *pkt, size_t caplen, payload &p)
+    {
+        if (caplen < min_len)
+            return false;
+        memcpy(&p, pkt + offset, sizeof(p));
+        return p.magic == magic;
+    }
+
+
+    struct stat
+    {
+        uint64_t received;
+        uint64_t lost;
+        uint64_t dup;
+        uint64_t reordered;
+    };
+
+    //
+    // receiver side of a stream: updated by the capture thread only,
+    // read by the stats thread...
+    //
+
+    struct stream
+    {
+        static constexpr size_t window = 4096;
+
+        stream()
+        : first(0), last(0), received(0), dup(0), reordered(0)
+        {}
+
+        void account(uint64_t seq, uint64_t latency)
+        {
+            auto n = received.load(std::memory_order_relaxed);
+            auto top = last.load(std::memory_order_relaxed);
+
+            if (n == 0) {
+                first.store(seq, std::memory_order_relaxed);
+                top = seq;
+                last.store(seq, std::memory_order_relaxed);
+                seen.set(seq % window);
+            }
+            else if (seq > top) {
+                if (seq - top >= window)
+                    seen.reset();
+                else
+                    for(auto s = top + 1; s < seq; s++)
+                        seen.reset(s % window);
+                seen.set(seq % window);
+                last.store(seq, std::memory_order_relaxed);
+            }
+            else if (top - seq >= window) {
+                reordered.store(reordered.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            else if (seen.test(seq % window)) {
+                dup.store(dup.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            else {
+                if (seq < first.load(std::memory_order_relaxed))
+                    first.store(seq, std::memory_order_relaxed);
+                seen.set(seq % window);
+                reordered.store(reordered.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+
+            received.store(n + 1, std::memory_order_relaxed);
+            nsec.record(latency);
+        }
+
+        operator stat() const
+        {
+            auto n   = received.load(std::memory_order_relaxed);
+            auto d   = dup.load(std::memory_order_relaxed);
+            auto r   = reordered.load(std::memory_order_relaxed);
+            auto exp = n ? last.load(std::memory_order_relaxed) - first.load(std::memory_order_relaxed) + 1 : 0;
+            return { n, exp > n - d ? exp - (n - d) : 0, d, r };
+        }
+
+        std::atomic<uint64_t> first;
+        std::atomic<uint64_t> last;
+        std::atomic<uint64_t> received;
+        std::atomic<uint64_t> dup;
+        std::atomic<uint64_t> reordered;
+
+        atomic_log_histogram<> nsec;
+
+        std::bitset<window> seen;
+    };
+
+
+    struct receiver
+    {
+        void account(const unsigned char *pkt, size_t caplen)
+        {
+            payload p;
+            if (!decode(pkt, caplen, p) || p.stream >= max_streams)
+                return;
+            auto t = now();
+            streams[p.stream].account(p.seq, t > p.tstamp ? t - p.tstamp : 0);
+        }
+
+        std::array<stream, max_streams> streams;
+    };
+}
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iosfwd>
+
+#include <capthread.hpp>
+#include <options.hpp>
+
+//
+// Machine-readable stats: one record per interval (and one for the whole
+// run), written as JSON lines or CSV rows by the stats thread.
+//
+
+struct stats_record
+{
+    const char *type;           // "interval" or "summary"
+    double timestamp;           // unix time (sec)
+    double interval;            // sec
+
+    std::vector<capthread::stat> threads;   // counters since start
+    std::vector<capthread::stat> delta;     // counters in this interval
+
+    struct pcap_stat kernel;                // since start
+    struct pcap_stat kernel_delta;          // in this interval
+};
+
+
+struct record_writer
+{
+    virtual ~record_writer();
+
+    virtual void write(stats_record const &) = 0;
+
+    // format is "json" or "csv", an empty filename means stdout...
+    //
+
+    static std::unique_ptr<record_writer> make(std::string const &format, std::string const &filename);
+
+protected:
+
+    record_writer(FILE *out);
+
+    FILE *out_;
+};
+
+
+// where the human-readable messages go: stderr when the records are
+// written to stdout, so that these can still be parsed...
+//
+
+std::ostream &messages(options const &opt);
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+
+#include <capthread.hpp>
+
+//
+// the stats lines of captop, formatted into any stream (the bench
+// measures them into a string stream)...
+//
+
+//
+// label of a stats line: "*", "TOT", "#3", "s1"...
+//
+
+struct tid
+{
+    tid(const char *name)
+    {
+        snprintf(buf, sizeof(buf), "%s", name);
+    }
+
+    tid(char prefix, size_t index)
+    {
+        snprintf(buf, sizeof(buf), "%c%zu", prefix, index);
+    }
+
+    char buf[24];
+};
+
+inline std::ostream &
+operator<<(std::ostream &out, tid const &t)
+{
+    return out << std::setw(4) << t.buf << "| ";
+}
+
+
+void print_stats(std::ostream &out, tid const &id, capthread::stat const &t, capthread::stat const &t_, std::chrono::duration<double> delta);
+
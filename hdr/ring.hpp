@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <linux/if_packet.h>
+#include <arpa/inet.h>
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+struct bpf_program;
+
+//
+// TPACKET_V2 rings on AF_PACKET sockets: the RX ring is filled by the
+// kernel and released frame by frame, the TX ring is filled by the
+// caller and flushed with a single send() per batch.
+//
+
+namespace ring
+{
+    struct socket
+    {
+        // the filter (if any) is attached before the socket is bound, so
+        // that no frame enters the ring unfiltered...
+        //
+
+        socket(std::string const &ifname, int ring, size_t bytes, struct bpf_program const *filter = nullptr);
+        ~socket();
+
+        socket(socket const &) = delete;
+        socket& operator=(socket const &) = delete;
+
+        struct tpacket2_hdr *frame(size_t i) const
+        {
+            return reinterpret_cast<struct tpacket2_hdr *>(map + i * frame_size);
+        }
+
+        int fd;
+        uint8_t *map;
+        size_t map_size;
+        size_t frame_size;
+        size_t frames;
+        size_t head;
+    };
+
+
+    struct rx : socket
+    {
+        rx(std::string const &ifname, size_t bytes, struct bpf_program const *filter = nullptr);
+
+        // next frame filled by the kernel, or nullptr...
+        //
+
+        struct tpacket2_hdr *next() const
+        {
+            auto h = frame(head);
+            return (__atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) ? h : nullptr;
+        }
+
+        const uint8_t *data(struct tpacket2_hdr const *h) const
+        {
+            return reinterpret_cast<const uint8_t *>(h) + h->tp_mac;
+        }
+
+        // the frame as it was on the wire: the 802.1Q tag stripped by the
+        // NIC (RX VLAN offload) is inserted back after the MAC addresses...
+        //
+
+        static bool tagged(struct tpacket2_hdr const *h)
+        {
+            return (h->tp_status & TP_STATUS_VLAN_VALID) != 0;
+        }
+
+        static size_t length(struct tpacket2_hdr const *h)
+        {
+            return h->tp_snaplen + (tagged(h) ? 4 : 0);
+        }
+
+        void copy(struct tpacket2_hdr const *h, uint8_t *to) const
+        {
+            auto p = data(h);
+
+            if (!tagged(h)) {
+                memcpy(to, p, h->tp_snaplen);
+                return;
+            }
+
+            uint16_t tag[2] = { htons((h->tp_status & TP_STATUS_VLAN_TPID_VALID) ? h->tp_vlan_tpid : 0x8100),
+                                htons(h->tp_vlan_tci) };
+            memcpy(to, p, 12);
+            memcpy(to + 12, tag, 4);
+            memcpy(to + 16, p + 12, h->tp_snaplen - 12);
+        }
+
+        void release()
+        {
+            __atomic_store_n(&frame(head)->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            head = head + 1 == frames ? 0 : head + 1;
+        }
+
+        bool wait(int timeout) const;
+
+        uint64_t drops();           // kernel drops since the previous call
+
+        bool gro;                   // on: merged frames exceed a ring frame
+    };
+
+
+    struct tx : socket
+    {
+        tx(std::string const &ifname, size_t bytes);
+
+        // room for len bytes in the next frame, or nullptr (ring full)...
+        //
+
+        uint8_t *slot(size_t len) const
+        {
+            auto h = frame(head);
+            if (len > frame_size - offset ||
+                __atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE)
+                return nullptr;
+            return reinterpret_cast<uint8_t *>(h) + offset;
+        }
+
+        void commit(size_t len)
+        {
+            auto h = frame(head);
+            h->tp_len = static_cast<uint32_t>(len);
+            __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+            head = head + 1 == frames ? 0 : head + 1;
+            pending++;
+        }
+
+        void flush();
+
+        size_t offset;              // of the packet in the frame
+        size_t pending;
+    };
+
+
+    // forwarding counters not covered by capthread::stat...
+    //
+
+    struct meter
+    {
+        meter()
+        : full(0), truncated(0), kdrop(0)
+        {}
+
+        void add(std::atomic<uint64_t> &c, uint64_t n)
+        {
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        std::atomic<uint64_t> full;         // TX ring full events
+        std::atomic<uint64_t> truncated;    // larger than an RX frame
+        std::atomic<uint64_t> kdrop;        // RX ring full (kernel)
+    };
+}
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Hardware RX queues of a NIC: the IRQ of each queue and the core that
+// services it (/proc/interrupts, /proc/irq/N/smp_affinity_list), joining
+// a PACKET_FANOUT_QM group so that socket n receives queue n, and the
+// per-queue packet counters of the driver (ETHTOOL_GSTATS).
+//
+
+namespace rxqueue
+{
+    size_t count(std::string const &ifname);
+
+    // IRQ of each RX queue (-1 if not found)...
+    //
+
+    std::vector<int> irqs(std::string const &ifname, size_t nqueues);
+
+    int irq_core(int irq);              // -1 if unknown
+
+    // join the fanout group in queue-mapping mode...
+    //
+
+    void join_fanout(int fd, int group);
+
+
+    struct counters
+    {
+        counters(std::string const &ifname);
+        ~counters();
+
+        counters(counters const &) = delete;
+        counters& operator=(counters const &) = delete;
+
+        // packets per queue (empty if the driver has no per-queue stats)...
+        //
+
+        std::vector<uint64_t> read() const;
+
+        std::string ifname;
+        int fd;
+        uint32_t nstats;
+        std::vector<int> index;         // stat index of each queue
+    };
+}
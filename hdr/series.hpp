@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <histogram.hpp>
+
+//
+// Time series of the per-interval rates, kept by the stats thread with
+// bounded memory: running statistics (Welford mean/variance, min, max and
+// a log histogram for percentiles) for the whole run, plus an optional
+// ring of fixed-size raw samples (the most recent ones) for plotting.
+//
+
+namespace series
+{
+    const uint32_t magic   = 0x52535443;    // "CTSR"
+    const uint32_t version = 1;
+    const uint32_t total   = 0xffffffff;    // thread id of the total
+
+    struct sample
+    {
+        uint64_t time;          // nsec since the beginning of the run
+        uint32_t thread;
+        uint32_t reserved;
+        double   pps;
+        double   bps;
+        double   drop;          // drops per second
+    };
+
+
+    struct running
+    {
+        running()
+        : n(0), mean(0), m2(0)
+        , min(std::numeric_limits<double>::max())
+        , max(0)
+        , hist()
+        {}
+
+        void add(double v)
+        {
+            n++;
+            auto d = v - mean;
+            mean += d / n;
+            m2   += d * (v - mean);
+            min   = std::min(min, v);
+            max   = std::max(max, v);
+            hist.count[log_histogram<>::index(static_cast<uint64_t>(v))]++;
+            hist.max = static_cast<uint64_t>(max);
+        }
+
+        double stddev() const
+        {
+            return n > 1 ? std::sqrt(m2 / (n - 1)) : 0;
+        }
+
+        double percentile(double p) const
+        {
+            return static_cast<double>(hist.percentile(p));
+        }
+
+        uint64_t n;
+        double mean;
+        double m2;
+        double min;
+        double max;
+        log_histogram<> hist;
+    };
+
+
+    struct summary
+    {
+        running pps;
+        running bps;
+        running drop;
+    };
+
+
+    struct recorder
+    {
+        // nthreads summaries plus the total (last), capacity raw samples...
+        //
+
+        recorder(size_t nthreads, size_t capacity)
+        : stats(nthreads + 1)
+        , ring()
+        , capacity_(capacity)
+        , next_(0)
+        {
+            ring.reserve(capacity);
+        }
+
+        void add(uint64_t time, uint32_t thread, double pps, double bps, double drop)
+        {
+            auto &s = stats.at(thread == total ? stats.size() - 1 : thread);
+            s.pps.add(pps);
+            s.bps.add(bps);
+            s.drop.add(drop);
+
+            if (capacity_ == 0)
+                return;
+
+            sample x = { time, thread, 0, pps, bps, drop };
+            if (ring.size() < capacity_)
+                ring.push_back(x);
+            else
+                ring[next_] = x;
+            next_ = (next_ + 1) % capacity_;
+        }
+
+        // write the raw samples (oldest first) as CSV if the filename ends
+        // with .csv, in binary otherwise...
+        //
+
+        void dump(std::string const &filename) const;
+
+        std::vector<summary> stats;
+        std::vector<sample> ring;
+
+    private:
+        size_t capacity_;
+        size_t next_;
+    };
+}
@@ -0,0 +1,164 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+//
+// Live stats published in a POSIX shared-memory segment:
+//
+//   [ header | thread_record x nthreads ]
+//
+// The header and every record are protected by their own seqlock (the
+// sequence is odd while the stats thread is updating them): readers copy
+// the payload and retry if the sequence changed meanwhile. Readers must
+// check magic/version and use header_size/record_size to locate records.
+//
+
+namespace shm
+{
+    const uint32_t magic   = 0x504f5443;    // "CTOP"
+    const uint32_t version = 1;
+
+    struct counters
+    {
+        uint64_t in_count;
+        uint64_t out_count;
+        uint64_t in_band;
+        uint64_t out_band;
+        uint64_t fail;
+
+        double in_pps;
+        double in_bps;
+        double out_pps;
+        double out_bps;
+        double fail_ps;
+    };
+
+    struct global_data
+    {
+        uint64_t timestamp;     // unix time of the last update (nsec)
+        uint64_t interval;      // length of the last interval (nsec)
+        uint64_t updates;
+
+        uint64_t ps_recv;
+        uint64_t ps_drop;
+        uint64_t ps_ifdrop;
+
+        double drop_ps;
+        double ifdrop_ps;
+
+        counters total;
+    };
+
+    struct alignas(64) header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t header_size;
+        uint32_t record_size;
+        uint32_t nthreads;
+        int32_t  pid;
+
+        std::atomic<uint32_t> seq;
+        global_data data;
+    };
+
+    struct alignas(64) thread_record
+    {
+        std::atomic<uint32_t> seq;
+        uint32_t id;
+        counters data;
+    };
+
+
+    inline size_t segment_size(size_t nthreads)
+    {
+        return sizeof(header) + nthreads * sizeof(thread_record);
+    }
+
+    inline thread_record *
+    record(header *h, size_t n)
+    {
+        return reinterpret_cast<thread_record *>(reinterpret_cast<char *>(h) + h->header_size + n * h->record_size);
+    }
+
+    //
+    // seqlock...
+    //
+
+    template <typename T>
+    inline void write(std::atomic<uint32_t> &seq, T &dst, T const &src)
+    {
+        auto s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        dst = src;
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    template <typename T>
+    inline T read(std::atomic<uint32_t> const &seq, T const &src)
+    {
+        for(;;)
+        {
+            auto s0 = seq.load(std::memory_order_acquire);
+            if (s0 & 1)
+                continue;
+            T ret = src;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s0)
+                return ret;
+        }
+    }
+
+
+    //
+    // publisher side, owned by the stats thread...
+    //
+
+    struct publisher
+    {
+        publisher(std::string name, size_t nthreads);
+        ~publisher();
+
+        publisher(publisher const &) = delete;
+        publisher& operator=(publisher const &) = delete;
+
+        void update(global_data const &g)
+        {
+            write(hdr_->seq, hdr_->data, g);
+        }
+
+        void update(size_t n, counters const &c)
+        {
+            auto r = record(hdr_, n);
+            write(r->seq, r->data, c);
+        }
+
+    private:
+        std::string name_;
+        size_t size_;
+        header *hdr_;
+    };
+}
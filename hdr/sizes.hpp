@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <pcap/pcap.h>
+
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Frame size distribution. Lengths are taken on the wire and include the
+// 4 bytes of FCS stripped by the NIC, so that a minimum size frame falls
+// in the 64 bucket as in RFC 2819 (etherStatsPkts64Octets...).
+//
+// Two layouts: the RFC 2819 buckets, and 64-byte steps up to jumbo
+// frames. Both map a length to a bin with a single table load or shift.
+//
+
+namespace sizes
+{
+    const size_t fcs = 4;
+
+    const size_t rfc_bins  = 8;
+    const size_t fine_step = 64;
+    const size_t fine_bins = 9216 / fine_step + 1;        // last bin: jumbo and beyond
+
+    const size_t max_bins  = fine_bins;
+
+    const char * const rfc_name[rfc_bins] = { "<64", "64", "65-127", "128-255", "256-511", "512-1023", "1024-1518", "1519+" };
+
+
+    struct tables
+    {
+        tables()
+        {
+            for(size_t n = 0; n < rfc.size(); n++)
+                rfc[n] = n <  64   ? 0 :
+                         n == 64   ? 1 :
+                         n <  128  ? 2 :
+                         n <  256  ? 3 :
+                         n <  512  ? 4 :
+                         n <  1024 ? 5 :
+                         n <  1519 ? 6 : 7;
+        }
+
+        std::array<uint8_t, 1520> rfc;
+    };
+
+    inline tables const &
+    get_tables()
+    {
+        static const tables t;
+        return t;
+    }
+
+
+    inline size_t
+    bins(bool fine)
+    {
+        return fine ? fine_bins : rfc_bins;
+    }
+
+    inline std::string
+    bin_name(bool fine, size_t b)
+    {
+        if (!fine)
+            return rfc_name[b];
+        if (b == fine_bins - 1)
+            return std::to_string(b * fine_step) + '+';
+        return std::to_string(b * fine_step) + '-' + std::to_string(b * fine_step + fine_step - 1);
+    }
+
+
+    typedef std::array<uint64_t, max_bins> snapshot;
+
+
+    //
+    // per-thread counters: single writer (relaxed load/store), read by
+    // the stats thread...
+    //
+
+    struct meter
+    {
+        meter(bool f)
+        : fine(f), tab(get_tables())
+        {
+            for(auto &c : count)
+                c.store(0, std::memory_order_relaxed);
+        }
+
+        void account(const struct pcap_pkthdr *h)
+        {
+            size_t len = h->len + fcs;
+            size_t b   = fine ? std::min<size_t>(len / fine_step, fine_bins - 1)
+                              : tab.rfc[std::min<size_t>(len, tab.rfc.size() - 1)];
+
+            count[b].store(count[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        // add the counters of this thread to s...
+        //
+
+        void read(snapshot &s) const
+        {
+            for(size_t b = 0; b < max_bins; b++)
+                s[b] += count[b].load(std::memory_order_relaxed);
+        }
+
+        bool fine;
+        tables const &tab;
+        std::atomic<uint64_t> count[max_bins];
+    };
+}
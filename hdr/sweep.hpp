@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <options.hpp>
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//
+// RFC 2544-style throughput sweep: for every frame size, a paced
+// generator on the output interface and a receiver on the input one
+// binary-search the highest offered rate whose loss stays below the
+// threshold. Frames carry a trial marker, so other traffic and late
+// frames of previous trials are not counted.
+//
+
+namespace sweep
+{
+    // frame sizes on the wire (FCS included): "rfc" or a list...
+    //
+
+    std::vector<size_t> sizes(std::string const &list);
+
+    struct result
+    {
+        size_t frame;
+        double pps;             // highest rate within the loss threshold
+        double loss;            // percent, at that rate
+        size_t trials;
+    };
+
+    // cores: receiver, generator...
+    //
+
+    std::vector<result> run(options const &opt, std::string const &filter, std::vector<size_t> const &cores);
+
+    void print(std::vector<result> const &results);
+}
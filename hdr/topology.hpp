@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <sched.h>
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//
+// CPU and NIC topology from sysfs: NUMA node of a NIC and of a core,
+// hyperthread siblings, and the placement of the capture threads.
+//
+
+namespace topology
+{
+    // "2,4,6-10" (sysfs cpulist format)...
+    //
+
+    std::vector<size_t> parse_list(std::string const &list);
+
+    std::vector<size_t> online();
+
+    int nic_node(std::string const &ifname);     // -1 if unknown
+    int cpu_node(size_t cpu);                    // -1 if unknown
+
+    size_t core_id(size_t cpu);                  // first sibling of the physical core
+
+    // one core per thread: the cores of the node of the NIC first, one
+    // thread per physical core, then the siblings, then the other nodes...
+    //
+
+    std::vector<size_t> place(size_t nthreads, std::string const &ifname);
+
+    // warn about remote-node cores and threads sharing a physical core...
+    //
+
+    void check(std::vector<size_t> const &cores, std::string const &ifname);
+
+
+    //
+    // run the calling thread on a core while in scope, so that the memory
+    // it touches meanwhile is allocated on the node of that core (first
+    // touch)...
+    //
+
+    struct local_scope
+    {
+        local_scope(size_t cpu);
+        ~local_scope();
+
+        local_scope(local_scope const &) = delete;
+        local_scope& operator=(local_scope const &) = delete;
+
+        cpu_set_t saved;
+        bool restore;
+    };
+}
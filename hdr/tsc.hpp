@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace tsc
+{
+    //
+    // start/stop are meant to bracket a measured region: the lfence keeps
+    // the first read from being executed early, rdtscp waits for the
+    // region to retire. Where no TSC is available both fall back to
+    // the monotonic clock (in nanoseconds).
+    //
+
+    inline uint64_t start()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_lfence();
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    inline uint64_t stop()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int aux;
+        return __rdtscp(&aux);
+#else
+        return start();
+#endif
+    }
+
+    //
+    // cycles per nanosecond, measured once against steady_clock...
+    //
+
+    inline double cycles_per_ns()
+    {
+        static const double value = [] {
+#if defined(__x86_64__) || defined(__i386__)
+            auto t0 = std::chrono::steady_clock::now();
+            auto c0 = start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            auto c1 = stop();
+            auto t1 = std::chrono::steady_clock::now();
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            return ns > 0 ? static_cast<double>(c1 - c0) / ns : 1.0;
+#else
+            return 1.0;
+#endif
+        }();
+        return value;
+    }
+
+    template <typename T>
+    double to_ns(T cycles)
+    {
+        return static_cast<double>(cycles) / cycles_per_ns();
+    }
+}
@@ -23,6 +23,8 @@
 #include <cstring>
 #include <sstream>
 #include <chrono>
+#include <ostream>
+#include <type_traits>
 
 #include <vt100.hpp>
 
@@ -59,34 +61,68 @@ to_string(Ts&& ... args)
     return to_string_(out, std::forward<Ts>(args)...);
 }
 
+//
+// highlight and pretty return lightweight proxies that are formatted
+// directly into the output stream (no temporary strings)...
+//
+
+template <typename T>
+struct highlighted
+{
+    T value;
+};
+
+template <typename T>
+inline std::ostream &
+operator<<(std::ostream &out, highlighted<T> const &h)
+{
+    return out << vt100::BOLD << h.value << vt100::RESET;
+}
+
 template <typename T>
-std::string highlight (T const &value)
+inline highlighted<typename std::decay<T const>::type>
+highlight(T const &value)
 {
-    return to_string(vt100::BOLD, value, vt100::RESET);
+    return { value };
 }
 
 
 template <typename T, typename Duration>
 double persecond(T value, Duration dur)
 {
-    return static_cast<double>(value) * 1000000 /
-        std::chrono::duration_cast<std::chrono::microseconds>(dur).count();
+    return static_cast<double>(value) /
+        std::chrono::duration_cast<std::chrono::duration<double>>(dur).count();
 }
 
 
 template <typename T>
-std::string pretty(T value)
+struct pretty_value
 {
+    T value;
+};
+
+template <typename T>
+inline std::ostream &
+operator<<(std::ostream &out, pretty_value<T> const &p)
+{
+    auto value = p.value;
+
     if (value < 1000000000) {
     if (value < 1000000) {
     if (value < 1000) {
-         return to_string(value);
+         return out << value;
     }
-    else return to_string(value/1000, "_K");
+    else return out << value/1000 << "_K";
     }
-    else return to_string(value/1000000, "_M");
+    else return out << value/1000000 << "_M";
     }
-    else return to_string(value/1000000000, "_G");
+    else return out << value/1000000000 << "_G";
 }
 
+template <typename T>
+inline pretty_value<T>
+pretty(T value)
+{
+    return { value };
+}
 
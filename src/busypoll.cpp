@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <busypoll.hpp>
+#include <global.hpp>
+
+#include <sys/socket.h>
+#include <poll.h>
+#include <time.h>
+
+#include <stdexcept>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL            46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL     69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET     70
+#endif
+
+
+namespace busypoll
+{
+    // back-off: empty iterations spent spinning, then pausing, before
+    // sleeping in poll()...
+    //
+
+    static constexpr uint64_t spin_loops  = 1024;
+    static constexpr uint64_t pause_loops = 16384;
+    static constexpr int      pause_burst = 32;
+
+
+    bool
+    enable(pcap_t *p, int usec)
+    {
+        char errbuf[PCAP_ERRBUF_SIZE];
+
+        if (pcap_setnonblock(p, 1, errbuf) != 0)
+            throw std::runtime_error(std::string("pcap_setnonblock: ") + errbuf);
+
+        auto fd = pcap_fileno(p);
+
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+            throw std::runtime_error(std::string("SO_BUSY_POLL: ") + strerror(errno));
+
+        int one = 1, budget = 64;
+        if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0)
+            return false;
+
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget));
+        return true;
+    }
+
+
+    namespace
+    {
+        // the handler is wrapped to time the first packet of each batch...
+        //
+
+        struct context
+        {
+            pcap_handler handler;
+            u_char *user;
+            meter *m;
+            bool first;
+        };
+
+        void wakeup_handler(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes)
+        {
+            auto ctx = reinterpret_cast<context *>(user);
+
+            if (__builtin_expect(ctx->first, 0))
+            {
+                ctx->first = false;
+
+                struct timespec now;
+                clock_gettime(CLOCK_REALTIME, &now);
+
+                auto ns = (static_cast<int64_t>(now.tv_sec) - h->ts.tv_sec) * 1000000000 + now.tv_nsec - h->ts.tv_usec * 1000;
+                ctx->m->wakeup.record(ns > 0 ? static_cast<uint64_t>(ns) : 0);
+            }
+
+            ctx->handler(ctx->user, h, bytes);
+        }
+
+        inline void relax()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+    }
+
+
+    void
+    loop(pcap_t *p, size_t count, int timeout, pcap_handler handler, u_char *user, meter &m)
+    {
+        context ctx { handler, user, &m, true };
+
+        struct pollfd pfd = { pcap_fileno(p), POLLIN, 0 };
+
+        size_t left = count ? count : std::numeric_limits<size_t>::max();
+        uint64_t empty = 0;
+
+        while (left && !global::stop.load(std::memory_order_relaxed))
+        {
+            ctx.first = true;
+
+            auto n = pcap_dispatch(p, static_cast<int>(std::min<size_t>(left, std::numeric_limits<int>::max())),
+                                   wakeup_handler, reinterpret_cast<u_char *>(&ctx));
+            if (n < 0)
+            {
+                if (n == PCAP_ERROR_BREAK)
+                    break;
+                throw std::runtime_error("pcap_dispatch: " + std::string(pcap_geterr(p)));
+            }
+
+            m.inc(m.loops);
+
+            if (n > 0)
+            {
+                left = count ? left - std::min<size_t>(left, n) : left;
+                empty = 0;
+                continue;
+            }
+
+            m.inc(m.idle);
+
+            // adaptive back-off...
+            //
+
+            if (++empty < spin_loops)
+                continue;
+
+            if (empty < pause_loops)
+            {
+                for(int i = 0; i < pause_burst; i++)
+                    relax();
+                continue;
+            }
+
+            m.inc(m.sleeps);
+
+            auto r = poll(&pfd, 1, timeout);
+            if (r < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("poll: ") + strerror(errno));
+
+            // traffic again: spin; timeout: straight back to poll()...
+            empty = r > 0 ? 0 : pause_loops;
+        }
+    }
+}
@@ -19,10 +19,17 @@
 
 #include <signal.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
 #include <netinet/ip.h>
+#include <arpa/inet.h>
 #include <pcap/pcap.h>
 
 #include <string>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <cerrno>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -35,16 +42,32 @@
 #include <thread>
 #include <atomic>
 #include <memory>
+#include <algorithm>
 
 #include <capthread.hpp>
 #include <handler.hpp>
 #include <global.hpp>
 #include <options.hpp>
 #include <util.hpp>
+#include <tsc.hpp>
+#include <probe.hpp>
+#include <record.hpp>
+#include <shmstats.hpp>
+#include <series.hpp>
+#include <prefilter.hpp>
+#include <ebpf.hpp>
+#include <topology.hpp>
+#include <rxqueue.hpp>
+#include <ring.hpp>
+#include <flight.hpp>
+#include <sweep.hpp>
+#include <nulldev.hpp>
+#include <report.hpp>
+#include <generator.hpp>
 
 #include <pthread.h>
 
-int pcap_top_inject_file(options const &opt, int id);
+int pcap_top_inject_file(options const &opt, capthread *ctx);
 
 static inline
 void thread_affinity(std::thread &t, size_t n)
@@ -63,6 +86,99 @@ void thread_affinity(std::thread &t, size_t n)
 }
 
 
+//
+// keep the stats thread (formatting, file output) off the capture cores...
+//
+
+static inline
+void thread_affinity_except(std::thread &t, std::vector<size_t> const &cores)
+{
+    cpu_set_t cpuset;
+
+    CPU_ZERO(&cpuset);
+    for(long n = 0; n < sysconf(_SC_NPROCESSORS_ONLN); n++)
+        CPU_SET(n, &cpuset);
+
+    for(auto n : cores)
+        CPU_CLR(n, &cpuset);
+
+    if (CPU_COUNT(&cpuset) == 0)
+        return;
+
+    auto pth = t.native_handle();
+    if ( ::pthread_setaffinity_np(pth, sizeof(cpuset), &cpuset) != 0)
+        throw std::runtime_error("pthread_setaffinity_np");
+}
+
+
+static inline
+void thread_setup(capthread *ctx, options const &opt, std::string const &filter)
+{
+    if (opt.in.ifname.empty() && opt.in.filename.empty() && !opt.null_device)
+        return;
+
+    // count-only: loaded here so that errors are reported before the
+    // threads start...
+    //
+
+    if (opt.count_only)
+        ctx->count.reset(new ebpf::count_filter(opt.in.ifname, filter));
+
+    // null device: every thread loads its own copy, on the node of its
+    // core...
+    //
+
+    if (opt.null_device)
+        ctx->replay.reset(new nulldev::trace(opt.in.filename.empty() ? nulldev::synthesize(std::min<size_t>(opt.genlen, 1514), 4096, opt.rand_ip)
+                                                                     : nulldev::load(opt.in.filename, filter, opt.oflag, size_t(1) << 30)));
+
+    if (opt.latency)
+        ctx->latency.reset(new capthread::latency_stat(opt.latency));
+
+    if (opt.bridge)
+        ctx->ring.reset(new ring::meter);
+
+    if (opt.busy_poll && !opt.in.ifname.empty() && !opt.count_only)
+        ctx->busypoll.reset(new busypoll::meter);
+
+    if (opt.probe)
+        ctx->probe.reset(new probe::receiver);
+
+    if (opt.burst.slot)
+    {
+        // room for ~4 seconds of busy slots...
+        //
+        size_t cap = 1024;
+        while (cap < 4000000 / opt.burst.slot)
+            cap <<= 1;
+        ctx->burst.reset(new burst::meter(opt.burst.slot * 1000, cap));
+    }
+
+    if (opt.top)
+        ctx->flows.reset(new flows::meter(std::max<size_t>(1024, opt.top * 8)));
+
+    if (opt.breakdown)
+        ctx->breakdown.reset(new breakdown::meter);
+
+    if (!opt.sizes.empty())
+        ctx->sizes.reset(new sizes::meter(opt.sizes == "fine"));
+
+    if (!opt.patterns.empty())
+        ctx->patterns.reset(new patterns::meter(patterns::load(opt.patterns)));
+
+    if (opt.flight.size && !opt.count_only && !opt.bridge)
+        ctx->flight.reset(new flight::recorder(opt.flight.size, static_cast<uint64_t>(opt.flight.window * 1e9), opt.flight.match));
+
+    // the meters share one parse per packet...
+    //
+
+    if (opt.breakdown)
+        ctx->layers = packet::l3;
+    if (opt.top || !opt.patterns.empty())
+        ctx->layers = packet::l4;
+}
+
+
 void set_stop(int)
 {
     global::stop.store(true, std::memory_order_relaxed);
@@ -70,132 +186,1135 @@ void set_stop(int)
 
 
 template <typename Dur>
-void print_stats(std::string tid, capthread::stat const &t, capthread::stat const &t_, Dur delta)
+shm::counters make_counters(capthread::stat const &t, capthread::stat const &t_, Dur delta)
+{
+    return { t.in_count, t.out_count, t.in_band, t.out_band, t.fail,
+             persecond(t.in_count  - t_.in_count, delta),
+             persecond((t.in_band  - t_.in_band) * 8, delta),
+             persecond(t.out_count - t_.out_count, delta),
+             persecond((t.out_band - t_.out_band) * 8, delta),
+             persecond(t.fail - t_.fail, delta) };
+}
+
+
+using latency_histogram = log_histogram<>;
+
+
+void print_latency(tid const &id, latency_histogram const &h)
+{
+        std::cout << id;
+        std::cout << " latency p50: " << highlight(tsc::to_ns(h.percentile(50)));
+        std::cout << " p99: "         << highlight(tsc::to_ns(h.percentile(99)));
+        std::cout << " p99.9: "       << highlight(tsc::to_ns(h.percentile(99.9)));
+        std::cout << " max: "         << highlight(tsc::to_ns(h.max)) << " nsec";
+        std::cout << " (" << h.total() << " samples)";
+}
+
+
+void print_probe(size_t stream, probe::stat const &s, latency_histogram const &h)
+{
+        std::cout << tid('s', stream);
+        std::cout << " probes: "    << highlight(s.received);
+        std::cout << " lost: "      << highlight(s.lost);
+        std::cout << " dup: "       << highlight(s.dup);
+        std::cout << " reordered: " << highlight(s.reordered);
+        std::cout << " latency p50: " << highlight(h.percentile(50));
+        std::cout << " p99: "         << highlight(h.percentile(99));
+        std::cout << " p99.9: "       << highlight(h.percentile(99.9));
+        std::cout << " max: "         << highlight(h.max) << " nsec";
+}
+
+
+void print_burst(burst::report const &r, options const &opt)
+{
+        auto slot = std::chrono::microseconds(opt.burst.slot);
+
+        std::cout << tid("burst");
+        std::cout << " slots: " << highlight(r.slots);
+        std::cout << " peak: "  << highlight(persecond(r.peak_packets, slot)) << " pps ";
+        std::cout << highlight(pretty(persecond(r.peak_bytes * 8, slot))) << "bit/sec";
+
+        if (opt.burst.threshold)
+        {
+            std::cout << " bursts: " << highlight(r.bursts) << " (> " << opt.burst.threshold << " pps)";
+
+            if (r.bursts)
+            {
+                auto ts = r.worst_start * opt.burst.slot;
+                time_t sec = ts / 1000000;
+                struct tm tm;
+                char buf[32];
+                strftime(buf, sizeof(buf), "%T", localtime_r(&sec, &tm));
+
+                std::cout << " worst: " << highlight(buf) << '.' << std::setw(6) << std::setfill('0') << ts % 1000000 << std::setfill(' ')
+                          << " (" << r.worst_packets << " packets in " << r.worst_slots << " slots)";
+            }
+        }
+}
+
+
+template <typename Dur>
+void print_flow(size_t rank, flows::entry const &e, Dur delta)
+{
+        char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+        auto af = e.k.version == 6 ? AF_INET6 : AF_INET;
+
+        inet_ntop(af, e.k.src, src, sizeof(src));
+        inet_ntop(af, e.k.dst, dst, sizeof(dst));
+
+        std::cout << tid('@', rank);
+        std::cout << std::setw(e.k.version == 6 ? 40 : 16) << src << ':' << std::left << std::setw(5) << e.k.sport << std::right << " > ";
+        std::cout << std::setw(e.k.version == 6 ? 40 : 16) << dst << ':' << std::left << std::setw(5) << e.k.dport << std::right;
+        std::cout << " proto " << std::setw(3) << static_cast<int>(e.k.proto);
+        std::cout << " packets: " << highlight(e.packets) << '(' << highlight(persecond(e.packets, delta)) << " pps)";
+        std::cout << " bytes: "   << highlight(e.bytes)   << '(' << highlight(pretty(persecond(e.bytes * 8, delta))) << "bit/sec)";
+}
+
+
+template <typename Dur>
+void print_breakdown(breakdown::snapshot const &s, breakdown::snapshot const &s_, Dur delta)
+{
+        using namespace breakdown;
+
+        std::cout << tid("l3");
+        for(size_t i = 0; i < l3_count; i++)
+        {
+            uint64_t pkts = 0, bytes = 0;
+            for(size_t j = 0; j < l4_count; j++) {
+                pkts  += s.proto[i][j].packets - s_.proto[i][j].packets;
+                bytes += s.proto[i][j].bytes   - s_.proto[i][j].bytes;
+            }
+            if (pkts == 0)
+                continue;
+            std::cout << ' ' << l3_name[i] << ": " << highlight(persecond(pkts, delta)) << " pps "
+                      << highlight(pretty(persecond(bytes * 8, delta))) << "bit/sec";
+        }
+        std::cout << '\n';
+
+        std::cout << tid("l4");
+        for(size_t i = 0; i < l3_count; i++)
+            for(size_t j = l4_other; j < l4_count; j++)
+            {
+                auto pkts = s.proto[i][j].packets - s_.proto[i][j].packets;
+                if (pkts == 0)
+                    continue;
+                std::cout << ' ' << l3_name[i] << '/' << l4_name[j] << ": " << highlight(persecond(pkts, delta)) << " pps";
+            }
+        std::cout << '\n';
+
+        // busiest VLANs...
+        //
+
+        std::array<std::pair<uint64_t, size_t>, 8> busy {};
+        for(size_t v = 0; v < vlan_count; v++)
+        {
+            auto pkts = s.vlan[v].packets - s_.vlan[v].packets;
+            if (pkts > busy.back().first) {
+                busy.back() = std::make_pair(pkts, v);
+                std::sort(busy.begin(), busy.end(), [](std::pair<uint64_t, size_t> const &a, std::pair<uint64_t, size_t> const &b) { return a.first > b.first; });
+            }
+        }
+
+        std::cout << tid("vlan");
+        for(auto &b : busy)
+        {
+            if (b.first == 0)
+                break;
+            if (b.second == untagged)
+                std::cout << " untagged: ";
+            else
+                std::cout << ' ' << b.second << ": ";
+            std::cout << highlight(persecond(b.first, delta)) << " pps";
+        }
+        std::cout << '\n';
+}
+
+
+// share of packets per size bucket; empty buckets are skipped in the
+// fine layout...
+//
+
+void print_sizes(tid const &id, sizes::snapshot const &s, sizes::snapshot const &s_, bool fine)
+{
+        uint64_t tot = 0;
+        for(size_t b = 0; b < sizes::bins(fine); b++)
+            tot += s[b] - s_[b];
+
+        std::cout << id << "sizes:";
+        if (tot == 0) {
+            std::cout << " -";
+            return;
+        }
+
+        for(size_t b = 0; b < sizes::bins(fine); b++)
+        {
+            auto n = s[b] - s_[b];
+            if (fine && n == 0)
+                continue;
+            std::cout << ' ' << sizes::bin_name(fine, b) << ": " << highlight(std::round(1000.0 * n / tot) / 10) << '%';
+        }
+}
+
+
+// payload search: scan rate and the patterns with most hits...
+//
+
+template <typename Dur>
+void print_scan(patterns::meter::snapshot const &s, patterns::meter::snapshot const &s_, std::vector<std::string> const &pats, Dur delta)
+{
+        uint64_t hits = 0;
+        std::vector<std::pair<uint64_t, size_t>> top;
+
+        for(size_t n = 0; n < s.hits.size(); n++)
+        {
+            auto h = s.hits[n] - (n < s_.hits.size() ? s_.hits[n] : 0);
+            hits += h;
+            if (h)
+                top.emplace_back(h, n);
+        }
+
+        std::cout << tid("scan") << "packets: " << highlight(persecond(s.packets - s_.packets, delta)) << " pps";
+        std::cout << " scanned: " << highlight(pretty(persecond((s.bytes - s_.bytes) * 8, delta))) << "bit/sec";
+        std::cout << " matches: " << highlight(persecond(hits, delta)) << "/sec (" << patterns::isa() << ')' << '\n';
+
+        auto n = std::min<size_t>(top.size(), 10);
+        std::partial_sort(top.begin(), top.begin() + n, top.end(), [](std::pair<uint64_t, size_t> const &a, std::pair<uint64_t, size_t> const &b) { return a.first > b.first; });
+
+        for(size_t i = 0; i < n; i++)
+            std::cout << tid("") << '\'' << patterns::printable(pats[top[i].second]) << "': "
+                      << highlight(top[i].first) << " (" << highlight(persecond(top[i].first, delta)) << "/sec)" << '\n';
+}
+
+
+void print_running(tid const &id, const char *name, series::running const &r)
 {
-        auto in_pps  = persecond(t.in_count  - t_.in_count, delta);
-        auto out_pps = persecond(t.out_count - t_.out_count, delta);
-        auto in_bps  = persecond((t.in_band  - t_.in_band) * 8, delta);
-        auto out_bps = persecond((t.out_band - t_.out_band) * 8, delta);
-        auto fail_ps = persecond(t.fail - t_.fail, delta);
-
-        std::cout << std::setw(4) << tid <<  "| ";
-        std::cout << " packets: "  << (highlight(t.in_count)      + "(" + highlight(in_pps) + " pps)");
-        std::cout << " in-band: "  << (highlight(pretty(in_bps))  + "bit/sec");
-        std::cout << " injected: " << (highlight(t.out_count)     + "(" + highlight(out_pps) + " pps)");
-        std::cout << " fail: "     << (highlight(t.fail)          + "(" + highlight(fail_ps) + "/sec)");
-        std::cout << " out-band: " << (highlight(pretty(out_bps)) + "bit/sec");
+        std::cout << id << std::setw(5) << name << " min: " << highlight(r.n ? r.min : 0);
+        std::cout << " mean: "   << highlight(r.mean);
+        std::cout << " max: "    << highlight(r.max);
+        std::cout << " stddev: " << highlight(r.stddev());
+        std::cout << " p99: "    << highlight(r.percentile(99));
 }
 
 
-void thread_stats(options const &opt, pcap_t *pstat)
+void print_summary(tid const &id, series::summary const &s)
+{
+        print_running(id, "pps", s.pps);
+        std::cout << '\n';
+        print_running("", "bps", s.bps);
+        std::cout << '\n';
+        print_running("", "drop", s.drop);
+        std::cout << '\n';
+}
+
+
+//
+// periodic timer on CLOCK_MONOTONIC with absolute deadlines: the interval
+// does not drift with the time spent printing and is immune to NTP steps.
+//
+
+struct interval_timer
+{
+    interval_timer(std::chrono::microseconds period)
+    : fd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC))
+    {
+        if (fd == -1)
+            throw std::runtime_error("timerfd_create");
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        struct itimerspec spec;
+        spec.it_interval.tv_sec  = period.count() / 1000000;
+        spec.it_interval.tv_nsec = period.count() % 1000000 * 1000;
+        spec.it_value.tv_sec     = now.tv_sec  + spec.it_interval.tv_sec;
+        spec.it_value.tv_nsec    = now.tv_nsec + spec.it_interval.tv_nsec;
+        if (spec.it_value.tv_nsec >= 1000000000) {
+            spec.it_value.tv_sec++;
+            spec.it_value.tv_nsec -= 1000000000;
+        }
+
+        if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr) == -1)
+            throw std::runtime_error("timerfd_settime");
+    }
+
+    ~interval_timer()
+    {
+        ::close(fd);
+    }
+
+    // block until the next deadline, return the number of expirations...
+    //
+
+    uint64_t wait()
+    {
+        uint64_t n = 0;
+        while (::read(fd, &n, sizeof(n)) == -1 && errno == EINTR)
+        {}
+        return n;
+    }
+
+    int fd;
+};
+
+
+void thread_stats(options const &opt, pcap_t *pstat, std::unique_ptr<record_writer> writer, std::unique_ptr<shm::publisher> shmem)
 {
     struct pcap_stat stat_ = {0, 0, 0}, stat = {0, 0, 0};
-    std::vector<capthread::stat> tstats_;
 
-    auto read_tstat = [] {
-        std::vector<capthread::stat> s;
+    // buffers are reused across intervals...
+    //
+
+    std::vector<capthread::stat> tstat, tstat_;
+
+    auto read_tstat = [] (std::vector<capthread::stat> &s) {
+        s.clear();
         for(auto &t : global::thread_ctx)
         {
+            // count-only: the stats thread is the writer...
+            if (t->count) {
+                auto c = t->count->read();
+                t->atomic_stat.in_count.store(c.slot[ebpf::total].packets, std::memory_order_relaxed);
+                t->atomic_stat.in_band.store(c.slot[ebpf::total].bytes, std::memory_order_relaxed);
+            }
             s.push_back(static_cast<capthread::stat>(t->atomic_stat));
         }
-        return s;
     };
 
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // per-thread kernel counters (each capture thread owns its socket)...
+    //
+
+    std::vector<struct pcap_stat> kstat, kstat_;
+
+    auto read_kstat = [] (std::vector<struct pcap_stat> &s) {
+        std::lock_guard<std::mutex> lock(global::syncstats);
+        s.resize(global::thread_ctx.size());
+        for(size_t i = 0; i < s.size(); i++)
+        {
+            auto p = global::thread_ctx[i]->pstat;
+            if (!p || pcap_stats(p, &s[i]) < 0)
+                s[i] = { 0, 0, 0 };
+        }
+    };
+
+    // handler latency: cumulative histograms per thread, the per-interval
+    // figures are the difference between two snapshots...
+    //
+
+    std::vector<latency_histogram> tlat, tlat_, tlat_run;
+
+    auto read_tlat = [&] (std::vector<latency_histogram> &s) {
+        s.resize(global::thread_ctx.size());
+        for(size_t i = 0; i < global::thread_ctx.size(); i++)
+        {
+            auto &lat = global::thread_ctx[i]->latency;
+            if (!lat) {
+                s[i] = latency_histogram{};
+                continue;
+            }
+            s[i] = lat->cycles;
+            s[i].max = lat->cycles.reset_max();
+            tlat_run[i].max = std::max(tlat_run[i].max, s[i].max);
+        }
+    };
+
+    auto print_tlat = [&] (std::vector<latency_histogram> const &tlat, std::vector<latency_histogram> const &tlat_) {
+        latency_histogram tot = {};
+        for(size_t i = 0; i < tlat.size(); i++)
+        {
+            auto h = tlat[i] - tlat_[i];
+            if (opt.numthread > 1) {
+                print_latency(tid('#', i), h);
+                std::cout << '\n';
+            }
+            tot += h;
+        }
+        print_latency(opt.numthread > 1 ? "TOT" : "*", tot);
+        std::cout << '\n';
+    };
+
+    if (opt.latency)
+        tsc::cycles_per_ns();
+
+    // bridge: per-direction events of the rings...
+    //
+
+    struct ring_stat
+    {
+        uint64_t full, truncated, kdrop;
+    };
+
+    std::vector<ring_stat> rs_(global::thread_ctx.size(), ring_stat{0, 0, 0});
+
+    auto print_bridge = [&] (std::chrono::steady_clock::duration delta) {
+        for(size_t i = 0; i < global::thread_ctx.size(); i++)
+        {
+            auto &m = global::thread_ctx[i]->ring;
+            if (!m)
+                continue;
+
+            ring_stat r = { m->full.load(std::memory_order_relaxed),
+                            m->truncated.load(std::memory_order_relaxed),
+                            m->kdrop.load(std::memory_order_relaxed) };
+
+            std::cout << tid('#', i) << ' ' << (i == 0 ? opt.in.ifname : opt.out.ifname) << " > " << (i == 0 ? opt.out.ifname : opt.in.ifname);
+            std::cout << " tx-full: "    << highlight(persecond(r.full - rs_[i].full, delta)) << "/s";
+            std::cout << " truncated: "  << highlight(persecond(r.truncated - rs_[i].truncated, delta)) << " pps";
+            std::cout << " rx-drop: "    << highlight(persecond(r.kdrop - rs_[i].kdrop, delta)) << " pps" << '\n';
+
+            rs_[i] = r;
+        }
+    };
+
+    // busy polling: wakeup latency (nanoseconds) and idle iterations of
+    // the capture loop, per thread...
+    //
+
+    std::vector<latency_histogram> wlat_(global::thread_ctx.size(), latency_histogram{});
+    std::vector<busypoll::stat> bp_(global::thread_ctx.size(), busypoll::stat{0, 0, 0});
+
+    auto print_busypoll = [&] (std::chrono::steady_clock::duration delta) {
+        for(size_t i = 0; i < global::thread_ctx.size(); i++)
+        {
+            auto &m = global::thread_ctx[i]->busypoll;
+            if (!m)
+                continue;
+
+            latency_histogram w = m->wakeup;
+            w.max = m->wakeup.reset_max();
+            busypoll::stat b = *m;
+
+            auto h     = w - wlat_[i];
+            auto loops = b.loops - bp_[i].loops;
+            auto idle  = b.idle  - bp_[i].idle;
+
+            std::cout << (opt.numthread > 1 ? tid('#', i) : tid("*"));
+            std::cout << " wakeup p50: " << highlight(h.percentile(50));
+            std::cout << " p99: "        << highlight(h.percentile(99));
+            std::cout << " p99.9: "      << highlight(h.percentile(99.9));
+            std::cout << " max: "        << highlight(h.max) << " nsec";
+            std::cout << " idle: "       << highlight(loops ? std::round(1000.0 * idle / loops) / 10 : 0.0) << "%";
+            std::cout << " sleeps: "     << highlight(persecond(b.sleeps - bp_[i].sleeps, delta)) << "/s" << '\n';
+
+            wlat_[i] = w;
+            bp_[i]   = b;
+        }
+    };
+
+    // one-way latency of probe streams (nanoseconds)...
+    //
+
+    probe::receiver *rx = nullptr;
+    for(auto &t : global::thread_ctx)
+        if (t->probe)
+            rx = t->probe.get();
+
+    std::vector<latency_histogram> plat_(probe::max_streams, latency_histogram{}),
+                                   plat_run(probe::max_streams, latency_histogram{});
+
+    auto print_probes = [&] (bool run) {
+        for(size_t i = 0; i < probe::max_streams; i++)
+        {
+            auto &ps = rx->streams[i];
+            probe::stat st = ps;
+            if (st.received == 0)
+                continue;
+
+            latency_histogram h = ps.nsec;
+            h.max = ps.nsec.reset_max();
+            plat_run[i].max = std::max(plat_run[i].max, h.max);
+
+            if (run)
+                h.max = plat_run[i].max;
+
+            print_probe(i, st, run ? h : h - plat_[i]);
+            std::cout << '\n';
+            plat_[i] = h;
+        }
+    };
+
+    // microbursts: slots closed by the capture threads since the last interval...
+    //
+
+    std::vector<burst::slot> slots;
+
+    auto read_bursts = [&] {
+        uint64_t overflow = 0;
+        slots.clear();
+        for(auto &t : global::thread_ctx)
+        {
+            if (!t->burst)
+                continue;
+            t->burst->drain([&](burst::slot const &s) { slots.push_back(s); }, std::chrono::milliseconds(10));
+            overflow += t->burst->overflow.load(std::memory_order_relaxed);
+        }
+        return overflow;
+    };
+
+    auto print_bursts = [&] {
+        auto overflow = read_bursts();
+
+        // threshold in packets per slot...
+        //
+        uint64_t threshold = opt.burst.threshold ? std::max<uint64_t>(1, opt.burst.threshold * opt.burst.slot / 1000000) : 0;
+        print_burst(burst::analyze(slots, threshold), opt);
+        if (overflow)
+            std::cout << " overflow: " << highlight(overflow);
+        std::cout << '\n';
+    };
+
+    // top talkers: heavy hitters of all threads, merged...
+    //
+
+    std::vector<flows::entry> top;
+
+    auto read_top = [&] {
+        top.clear();
+        for(auto &t : global::thread_ctx)
+        {
+            if (!t->flows)
+                continue;
+            t->flows->collect([&](flows::table const &tab) {
+                top.insert(top.end(), tab.heap.begin(), tab.heap.end());
+            }, std::chrono::milliseconds(10));
+        }
+    };
+
+    auto print_top = [&] (std::chrono::steady_clock::duration delta) {
+        read_top();
+        flows::merge(top);
+
+        auto n = std::min(opt.top, top.size());
+
+        std::partial_sort(top.begin(), top.begin() + n, top.end(), [](flows::entry const &a, flows::entry const &b) { return a.packets > b.packets; });
+        std::cout << "top flows by packets:\n";
+        for(size_t i = 0; i < n; i++) {
+            print_flow(i + 1, top[i], delta);
+            std::cout << '\n';
+        }
+
+        std::partial_sort(top.begin(), top.begin() + n, top.end(), [](flows::entry const &a, flows::entry const &b) { return a.bytes > b.bytes; });
+        std::cout << "top flows by bytes:\n";
+        for(size_t i = 0; i < n; i++) {
+            print_flow(i + 1, top[i], delta);
+            std::cout << '\n';
+        }
+    };
+
+    // protocol/VLAN breakdown, summed over threads...
+    //
 
-    auto now_  = std::chrono::system_clock::now();
+    breakdown::snapshot bd, bd_;
 
-    if (!pstat) {
+    auto read_breakdown = [] (breakdown::snapshot &s) {
+        breakdown::clear(s);
+        for(auto &t : global::thread_ctx)
+            if (t->breakdown)
+                t->breakdown->read(s);
+    };
+
+    // frame size distribution, per thread...
+    //
+
+    auto fine = opt.sizes == "fine";
+
+    std::vector<sizes::snapshot> sz, sz_;
+
+    auto read_sizes = [] (std::vector<sizes::snapshot> &s) {
+        s.resize(global::thread_ctx.size());
+        for(size_t i = 0; i < s.size(); i++)
+        {
+            s[i].fill(0);
+            if (global::thread_ctx[i]->sizes)
+                global::thread_ctx[i]->sizes->read(s[i]);
+        }
+    };
+
+    auto print_sizes_all = [&] (std::vector<sizes::snapshot> const &s, std::vector<sizes::snapshot> const &s_) {
+        sizes::snapshot tot {}, tot_ {};
+        for(size_t i = 0; i < s.size(); i++)
+        {
+            if (!global::thread_ctx[i]->sizes)
+                continue;
+            for(size_t b = 0; b < sizes::max_bins; b++) {
+                tot[b]  += s[i][b];
+                tot_[b] += s_[i][b];
+            }
+            if (opt.numthread > 1) {
+                print_sizes(tid('#', i), s[i], s_[i], fine);
+                std::cout << '\n';
+            }
+        }
+        print_sizes(opt.numthread > 1 ? "TOT" : "*", tot, tot_, fine);
+        std::cout << '\n';
+    };
+
+    // payload search, summed over threads...
+    //
+
+    patterns::meter::snapshot scan, scan_;
+    std::vector<std::string> pats;
+
+    auto read_scan = [&] (patterns::meter::snapshot &s) {
+        s.packets = s.bytes = 0;
+        s.hits.assign(pats.size(), 0);
+        for(auto &t : global::thread_ctx)
+            if (t->patterns)
+                t->patterns->read(s);
+    };
+
+    for(auto &t : global::thread_ctx)
+        if (t->patterns) {
+            pats = t->patterns->m.pats;
+            break;
+        }
+
+    // count-only: per-protocol counters of the eBPF program...
+    //
+
+    ebpf::counters cnt, cnt_;
+
+    auto read_count = [] (ebpf::counters &c) {
+        c = ebpf::counters{};
+        for(auto &t : global::thread_ctx)
+            if (t->count) {
+                auto x = t->count->read();
+                for(size_t k = 0; k < ebpf::slots; k++) {
+                    c.slot[k].packets += x.slot[k].packets;
+                    c.slot[k].bytes   += x.slot[k].bytes;
+                }
+            }
+    };
+
+    // thread groups, one per interface (-i): the threads of a group are
+    // numbered in sequence...
+    //
+
+    struct group
+    {
+        std::string ifname;
+        size_t first;
+        size_t size;
+    };
+
+    std::vector<group> groups;
+
+    for(size_t i = 0; i < global::thread_ctx.size(); i++)
+    {
+        auto g = global::thread_ctx[i]->iface;
+        if (g >= groups.size())
+            groups.resize(g + 1, group{ g == 0 ? opt.in.ifname : opt.interfaces[g-1].ifname, i, 0 });
+        groups[g].size++;
+    }
+
+    // packet drops of a group: every capture socket counts its own, the
+    // interface drops are the same for all of them (the sockets of the
+    // generators are not read and do not count)...
+    //
+
+    auto capturing = [] (size_t i) {
+        auto &t = global::thread_ctx[i];
+        return t->pstat != nullptr && t->pstat == t->in;
+    };
+
+    auto group_drop = [&] (group const &g, std::chrono::steady_clock::duration delta) {
+        uint64_t drop = 0, ifdrop = 0;
+        bool first = true;
+        for(size_t i = g.first; i < g.first + g.size; i++)
+        {
+            if (!capturing(i))
+                continue;
+            drop += kstat[i].ps_drop - kstat_[i].ps_drop;
+            if (first)
+                ifdrop = kstat[i].ps_ifdrop - kstat_[i].ps_ifdrop;
+            first = false;
+        }
+        return std::make_pair(persecond(drop, delta), persecond(ifdrop, delta));
+    };
+
+    bool per_socket = false;
+    for(size_t i = 0; i < global::thread_ctx.size(); i++)
+        per_socket = per_socket || capturing(i);
+
+    // kernel counters of the run: the sum of the capture sockets (the
+    // interface drops once per group), those of pstat otherwise...
+    //
+
+    auto kernel_stat = [&] (std::vector<struct pcap_stat> const &k, struct pcap_stat &s) {
+        if (!per_socket)
+            return;
+        s = { 0, 0, 0 };
+        for(auto &g : groups)
+        {
+            bool first = true;
+            for(size_t i = g.first; i < g.first + g.size; i++)
+            {
+                if (!capturing(i))
+                    continue;
+                s.ps_recv += k[i].ps_recv;
+                s.ps_drop += k[i].ps_drop;
+                if (first)
+                    s.ps_ifdrop += k[i].ps_ifdrop;
+                first = false;
+            }
+        }
+    };
+
+    // per-queue packets of the driver, next to the threads bound to them...
+    //
+
+    std::vector<std::unique_ptr<rxqueue::counters>> rxq(groups.size());
+    std::vector<std::vector<uint64_t>> qs(groups.size()), qs_(groups.size());
+
+    if (opt.rx_queues)
+        for(size_t g = 0; g < groups.size(); g++)
+            rxq[g].reset(new rxqueue::counters(groups[g].ifname));
+
+    auto read_queues = [&] (std::vector<std::vector<uint64_t>> &q) {
+        for(size_t g = 0; g < rxq.size(); g++)
+            if (rxq[g])
+                q[g] = rxq[g]->read();
+    };
+
+    auto print_queues = [&] (size_t i, std::chrono::steady_clock::duration delta) {
+        auto &g = groups[global::thread_ctx[i]->iface];
+        auto &q = qs[global::thread_ctx[i]->iface], &q_ = qs_[global::thread_ctx[i]->iface];
+        if (q.size() != q_.size() || q.empty())
+            return;
+        uint64_t n = 0;
+        for(size_t k = i - g.first; k < q.size(); k += g.size)
+            n += q[k] - q_[k];
+        std::cout << " rxq: " << highlight(persecond(n, delta)) << " pps";
+    };
+
+    // wait for the threads to be released, then let the warm-up run
+    // (handles filling, caches and branch predictors getting warm) out of
+    // the measurement window...
+    //
+
+    while (!global::start.load(std::memory_order_acquire) && !global::stop.load(std::memory_order_relaxed))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    auto warmup_end = std::chrono::steady_clock::now() + std::chrono::microseconds(opt.warmup);
+    while (std::chrono::steady_clock::now() < warmup_end && !global::stop.load(std::memory_order_relaxed))
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(warmup_end - std::chrono::steady_clock::now(), std::chrono::milliseconds(10)));
+
+    if (!pstat && !opt.count_only && !opt.bridge && !opt.null_device && !opt.flight.size) {
         std::cout << "stats not available..." << std::endl;
         return;
     }
 
-    if (pcap_stats(pstat, &stat_) < 0) {
+    // count-only: no pcap handle, the counters come from the eBPF map...
+    //
+
+    std::unique_lock<std::mutex> lock(global::syncstats);
+
+    if (pstat && pcap_stats(pstat, &stat_) < 0) {
         std::cout << "cannot read stats: " << pcap_geterr(pstat) << std::endl;
         return;
     }
 
-    auto tstat_ = read_tstat();
+    lock.unlock();
+
+    // machine-readable records (JSON lines/CSV); the text output is
+    // suppressed when they go to stdout...
+    //
+
+    stats_record rec;
+
+    auto text = !writer || !opt.stats.file.empty();
+
+    auto fill_record = [&] (const char *type, std::vector<capthread::stat> const &t, std::vector<capthread::stat> const &t_,
+                            struct pcap_stat const &k, struct pcap_stat const &k_, std::chrono::steady_clock::duration delta) {
+        rec.type      = type;
+        rec.timestamp = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        rec.interval  = std::chrono::duration<double>(delta).count();
+        rec.threads   = t;
+        rec.delta.resize(t.size());
+        for(size_t i = 0; i < t.size(); i++)
+            rec.delta[i] = t[i] - t_[i];
+        rec.kernel = k;
+        rec.kernel_delta = { k.ps_recv - k_.ps_recv, k.ps_drop - k_.ps_drop, k.ps_ifdrop - k_.ps_ifdrop };
+    };
+
+    interval_timer timer(std::chrono::microseconds(opt.interval));
+
+    auto now_  = std::chrono::steady_clock::now();
+
+    read_tstat(tstat_);
     auto tsum_  = sum(tstat_);
 
-    for(;; std::this_thread::sleep_for(std::chrono::seconds(1)))
+    if (opt.breakdown)
+        read_breakdown(bd_);
+
+    if (opt.latency)
     {
+        tlat_run.assign(global::thread_ctx.size(), latency_histogram{});
+        read_tlat(tlat_);
+    }
+
+    if (!opt.sizes.empty())
+        read_sizes(sz_);
+
+    if (!pats.empty())
+        read_scan(scan_);
+
+    if (opt.count_only)
+        read_count(cnt_);
+
+    read_queues(qs_);
+
+    auto scan_start = scan_;
+    auto sz_start   = sz_;
+    auto tlat_start = tlat_;
+
+    read_kstat(kstat_);
+    kernel_stat(kstat_, stat_);
+
+    auto start   = now_;
+    auto tstart  = tstat_;
+    auto kstart  = stat_;
+
+    uint64_t updates = 0;
+
+    // time series of the rates, for the end-of-run summary...
+    //
+
+    series::recorder recorder(global::thread_ctx.size(), opt.series.file.empty() ? 0 : opt.series.size);
+
+    // flight recorders frozen by a trigger are written (and handed back)
+    // here, off the capture threads...
+    //
+
+    bool flight_above = false;
+
+    auto flight_dump = [&] {
+        for(auto &t : global::thread_ctx)
+        {
+            auto &f = t->flight;
+            if (!f || !f->frozen.load(std::memory_order_acquire))
+                continue;
+
+            auto name = opt.flight.file + "-" + std::to_string(t->id) + "-" + std::to_string(f->dumps) + ".pcap";
+            try {
+                auto n = f->dump(name);
+                (text ? std::cout : std::cerr) << "flight recorder: " << n << " packets dumped to " << name << std::endl;
+            }
+            catch(std::exception &e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    };
+
+    for(;;)
+    {
+        timer.wait();
+
         if (unlikely(global::stop.load(std::memory_order_relaxed)))
             break;
 
-        pcap_stats(pstat, &stat);
+        if (pstat) {
+            std::lock_guard<std::mutex> lock(global::syncstats);
+            pcap_stats(pstat, &stat);
+        }
 
-        auto now = std::chrono::system_clock::now();
-        auto tstat = read_tstat();
+        auto now = std::chrono::steady_clock::now();
+        read_tstat(tstat);
         auto tsum  = sum(tstat);
 
+        read_queues(qs);
+
+        // rates are computed on the measured interval...
+        //
+
         auto delta = now - now_;
 
+        read_kstat(kstat);
+        kernel_stat(kstat, stat);
+
         auto drop    = persecond(stat.ps_drop - stat_.ps_drop, delta);
         auto ifdrop  = persecond(stat.ps_ifdrop - stat_.ps_ifdrop, delta);
 
-        if (opt.numthread > 1)
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+
+        for(size_t i = 0; i < tstat.size(); i++)
+            recorder.add(elapsed, i, persecond(tstat[i].in_count - tstat_[i].in_count, delta),
+                                     persecond((tstat[i].in_band - tstat_[i].in_band) * 8, delta),
+                                     persecond(kstat[i].ps_drop - kstat_[i].ps_drop, delta));
+
+        recorder.add(elapsed, series::total, persecond(tsum.in_count - tsum_.in_count, delta),
+                                             persecond((tsum.in_band - tsum_.in_band) * 8, delta), drop);
+
+        // flight recorder: thresholds trigger on the rising edge only, the
+        // drops are those of every capture socket (see kernel_stat)...
+        //
+
+        if (opt.flight.size)
+        {
+            auto above = (opt.flight.pps  && persecond(tsum.in_count - tsum_.in_count, delta) > opt.flight.pps) ||
+                         (opt.flight.drop && drop > opt.flight.drop);
+            if (above && !flight_above)
+                flight::request();
+            flight_above = above;
+
+            flight_dump();
+        }
+
+        if (writer)
         {
-            for(size_t i = 0; i < tstat.size(); i++) {
-                print_stats('#' + std::to_string(i), tstat[i], tstat_[i], delta);
-                std::cout << std::endl;
+            fill_record("interval", tstat, tstat_, stat, stat_, delta);
+            writer->write(rec);
+        }
+
+        if (shmem)
+        {
+            for(size_t i = 0; i < tstat.size(); i++)
+                shmem->update(i, make_counters(tstat[i], tstat_[i], delta));
+
+            shm::global_data g;
+            g.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            g.interval  = std::chrono::duration_cast<std::chrono::nanoseconds>(delta).count();
+            g.updates   = ++updates;
+            g.ps_recv   = stat.ps_recv;
+            g.ps_drop   = stat.ps_drop;
+            g.ps_ifdrop = stat.ps_ifdrop;
+            g.drop_ps   = drop;
+            g.ifdrop_ps = ifdrop;
+            g.total     = make_counters(tsum, tsum_, delta);
+            shmem->update(g);
+        }
+
+        if (text)
+        {
+            if (opt.numthread > 1)
+            {
+                for(size_t i = 0; i < tstat.size(); i++) {
+                    print_stats(std::cout, tid('#', i), tstat[i], tstat_[i], delta);
+                    print_queues(i, delta);
+                    std::cout << '\n';
+                }
+
+                if (groups.size() > 1)
+                    for(auto &g : groups)
+                    {
+                        capthread::stat t = {0, 0, 0, 0, 0}, t_ = {0, 0, 0, 0, 0};
+                        for(size_t i = g.first; i < g.first + g.size; i++) {
+                            t  = t  + tstat[i];
+                            t_ = t_ + tstat_[i];
+                        }
+                        auto d = group_drop(g, delta);
+                        print_stats(std::cout, tid(g.ifname.c_str()), t, t_, delta);
+                        std::cout << " drop: " << highlight(d.first) << " pps, ifdrop: " << highlight(d.second) << " pps" << '\n';
+                    }
+
+                print_stats(std::cout, "TOT", tsum, tsum_, delta);
+                std::cout << " drop: " << highlight(drop) << " pps, ifdrop: " << highlight(ifdrop) << " pps" << '\n';
+            }
+            else
+            {
+                print_stats(std::cout, "*", tsum, tsum_, delta);
+                std::cout << " drop: " << highlight(drop) << " pps, ifdrop: " << highlight(ifdrop) << " pps" << '\n';
+            }
+
+            for(size_t g = 0; g < groups.size(); g++)
+            {
+                auto &q = qs[g], &q_ = qs_[g];
+                if (q.empty() || q.size() != q_.size())
+                    continue;
+                std::cout << tid("rxq");
+                if (groups.size() > 1)
+                    std::cout << ' ' << groups[g].ifname;
+                for(size_t k = 0; k < q.size(); k++)
+                    std::cout << ' ' << k << ": " << highlight(persecond(q[k] - q_[k], delta));
+                std::cout << " pps" << '\n';
             }
-            print_stats("TOT", tsum, tsum_, delta);
-            std::cout << " drop: " << highlight(drop) << " pps, ifdrop: " << highlight(ifdrop) << " pps" << std::endl;
+
+            if (opt.latency)
+            {
+                read_tlat(tlat);
+                print_tlat(tlat, tlat_);
+                tlat_.swap(tlat);
+            }
+
+            if (opt.bridge)
+                print_bridge(delta);
+
+            if (opt.busy_poll)
+                print_busypoll(delta);
+
+            if (rx)
+                print_probes(false);
+
+            if (opt.burst.slot)
+                print_bursts();
+
+            if (opt.top)
+                print_top(delta);
+
+            if (opt.breakdown)
+            {
+                read_breakdown(bd);
+                print_breakdown(bd, bd_, delta);
+                std::swap(bd, bd_);
+            }
+
+            if (!opt.sizes.empty())
+            {
+                read_sizes(sz);
+                print_sizes_all(sz, sz_);
+                sz_.swap(sz);
+            }
+
+            if (!pats.empty())
+            {
+                read_scan(scan);
+                print_scan(scan, scan_, pats, delta);
+                std::swap(scan, scan_);
+            }
+
+            if (opt.count_only)
+            {
+                read_count(cnt);
+                std::cout << tid("bpf");
+                for(size_t k = ebpf::tcp; k < ebpf::slots; k++)
+                    std::cout << ' ' << ebpf::slot_name[k] << ": " << highlight(persecond(cnt.slot[k].packets - cnt_.slot[k].packets, delta)) << " pps";
+                std::cout << '\n';
+                cnt_ = cnt;
+            }
+
+            std::cout.flush();
         }
         else
         {
-            print_stats("*", tsum, tsum_, delta);
-            std::cout << " drop: " << highlight(drop) << " pps, ifdrop: " << highlight(ifdrop) << " pps" << std::endl;
+            // records only: the slots and the flow tables are collected all
+            // the same, so that the rings do not overflow and the tables
+            // restart at every interval...
+            //
+
+            if (opt.burst.slot)
+                read_bursts();
+
+            if (opt.top)
+                read_top();
         }
 
-        tstat_ = tstat;
+        tstat_.swap(tstat);
+        kstat_.swap(kstat);
+        qs_.swap(qs);
         now_   = now;
         stat_  = stat;
-        tsum_  = std::move(tsum);
+        tsum_  = tsum;
+
+        // end of the measurement window (a whole number of intervals)...
+        //
+
+        if (opt.duration && now - start >= std::chrono::microseconds(opt.duration)) {
+            global::stop.store(true, std::memory_order_relaxed);
+            break;
+        }
     }
+
+    if (opt.flight.size)
+        flight_dump();
+
+    if (writer)
+    {
+        fill_record("summary", tstat_, tstart, stat_, kstart, now_ - start);
+        writer->write(rec);
+    }
+
+    // a failed dump must not lose the summary of the run...
+    //
+
+    if (!opt.series.file.empty())
+    {
+        try {
+            recorder.dump(opt.series.file);
+        }
+        catch(std::exception &e) {
+            std::cerr << "series: " << e.what() << std::endl;
+        }
+    }
+
+    if (!text)
+        return;
+
+    std::cout << "run summary (" << recorder.stats.back().pps.n << " intervals):" << std::endl;
+
+    if (opt.numthread > 1)
+        for(size_t i = 0; i + 1 < recorder.stats.size(); i++)
+            print_summary(tid('#', i), recorder.stats[i]);
+
+    print_summary(opt.numthread > 1 ? "TOT" : "*", recorder.stats.back());
+
+    if (opt.latency)
+    {
+        std::cout << "handler latency (whole run):" << std::endl;
+        read_tlat(tlat);
+        for(size_t i = 0; i < tlat.size(); i++)
+            tlat[i].max = tlat_run[i].max;
+        print_tlat(tlat, tlat_start);
+    }
+
+    if (rx)
+    {
+        std::cout << "probe streams (whole run):" << std::endl;
+        print_probes(true);
+    }
+
+    if (!opt.sizes.empty())
+    {
+        std::cout << "frame sizes (whole run):" << std::endl;
+        read_sizes(sz);
+        print_sizes_all(sz, sz_start);
+    }
+
+    if (!pats.empty())
+    {
+        std::cout << "payload search (whole run):" << std::endl;
+        read_scan(scan);
+        print_scan(scan, scan_start, pats, now_ - start);
+    }
+
+    std::cout.flush();
 }
 
 
-void print_pcap_stats(pcap_t *p, int id)
+void print_pcap_stats(std::ostream &out, pcap_t *p, int id)
 {
-    static std::mutex m;
-    std::lock_guard<std::mutex> lock(m);
+    std::lock_guard<std::mutex> lock(global::syncstats);
 
     struct pcap_stat stat;
 
-    std::cout << "#" << id << " thread:" << std::endl;
+    out << "#" << id << " thread:" << std::endl;
 
     auto &ctx = global::thread_ctx.at(id);
 
-    std::cout << ctx->atomic_stat.in_count.load(std::memory_order_relaxed) << " packets captured" << std::endl;
+    out << ctx->atomic_stat.in_count.load(std::memory_order_relaxed) << " packets captured" << std::endl;
 
     if (ctx->out) {
-        std::cout << ctx->atomic_stat.out_count.load(std::memory_order_relaxed) << " packets injected, "
-                  << ctx->atomic_stat.fail.load(std::memory_order_relaxed) << " send failed" << std::endl;
+        out << ctx->atomic_stat.out_count.load(std::memory_order_relaxed) << " packets injected, "
+            << ctx->atomic_stat.fail.load(std::memory_order_relaxed) << " send failed" << std::endl;
     }
 
     if (p && pcap_stats(p, &stat) != -1) {
-        std::cout << stat.ps_recv   << " packets received by filter" << std::endl;
-        std::cout << stat.ps_drop   << " packets dropped by kernel" << std::endl;
-        std::cout << stat.ps_ifdrop << " packets dropped by interface" << std::endl;
+        out << stat.ps_recv   << " packets received by filter" << std::endl;
+        out << stat.ps_drop   << " packets dropped by kernel" << std::endl;
+        out << stat.ps_ifdrop << " packets dropped by interface" << std::endl;
     }
 }
 
 
 int
-pcap_top_inject_file(options const &opt, int id)
+pcap_top_inject_file(options const &opt, capthread *ctx)
 {
     // print header...
     //
 
-    std::cout << "writing to " << opt.out.filename << std::endl;
+    messages(opt) << "writing to " << opt.out.filename << std::endl;
 
     // create a pcap handler
     //
 
-    auto &ctx = global::thread_ctx.at(id);
-
     if (!ctx->in)
         throw std::runtime_error("dump to file requires input source!");
 
@@ -209,14 +1328,13 @@ pcap_top_inject_file(options const &opt, int id)
 
 
 int
-pcap_top_inject_live(options const &opt, int id)
+pcap_top_inject_live(options const &opt, capthread *this_thread)
 {
     // print header...
     //
-    auto this_thread = global::thread_ctx.at(id).get();
 
     auto snap = opt.snaplen > opt.genlen ? opt.genlen : opt.snaplen;
-    std::cout << "injecting to " << opt.out.ifname << ", " << snap << " snaplen, " << opt.genlen << " genlen"  << std::endl;
+    messages(opt) << "injecting to " << opt.out.ifname << ", " << snap << " snaplen, " << opt.genlen << " genlen"  << std::endl;
 
     // create a pcap handler
     //
@@ -251,9 +1369,14 @@ struct pcap_top_file : public capthread
         if (in == nullptr)
             throw std::runtime_error("pcap_open_offline:" + std::string(errbuf));
 
-        // set BPF...
+        // set BPF, unless the expression is simple enough for the
+        // prefilter...
         //
-        if (!filter.empty())
+
+        prefilter::program prog;
+        auto batched = !filter.empty() && opt.prefilter && prefilter::compile(filter, prog);
+
+        if (!filter.empty() && !batched)
         {
             if (pcap_compile(in, &fcode, filter.c_str(), opt.oflag, PCAP_NETMASK_UNKNOWN) < 0)
                 throw std::runtime_error(std::string("pcap_compile: ") + pcap_geterr(in));
@@ -266,27 +1389,37 @@ struct pcap_top_file : public capthread
         //
 
         if (!opt.out.filename.empty())
-            pcap_top_inject_file(opt, id);
+            pcap_top_inject_file(opt, this);
 
         else if (!opt.out.ifname.empty())
-            pcap_top_inject_live(opt, id);
+            pcap_top_inject_live(opt, this);
 
         // print header...
         //
 
-        std::cout << "reading from " << opt.in.filename << "..." << std::endl;
+        messages(opt) << "reading from " << opt.in.filename << "..." << std::endl;
 
-        auto packet_handler = get_packet_handler(opt);
+        if (this->flight)
+            this->flight->linktype = pcap_datalink(this->in);
+
+        auto packet_handler = instrument_handler(opt, this, get_packet_handler(opt, this));
+
+        global::arrive();
 
         // start capture...
         //
-        if (!opt.next)
+        if (batched)
+        {
+            messages(opt) << "using prefilter: " << prefilter::to_string(prog) << std::endl;
+            read_batched(opt, prog, packet_handler);
+        }
+        else if (!opt.next)
         {
             if (pcap_loop(this->in, opt.count, packet_handler, reinterpret_cast<u_char *>(this)) == -1)
                 std::cerr << "pcap_loop: " << pcap_geterr(this->in) << std::endl;
         }
         else {
-            std::cout << "using pcap_next..." << std::endl;
+            messages(opt) << "using pcap_next..." << std::endl;
             auto stop = opt.count ? opt.count : std::numeric_limits<size_t>::max();
             for(size_t n = 0; n < stop; )
             {
@@ -304,13 +1437,70 @@ struct pcap_top_file : public capthread
         }
 
         if (this->dumper) {
-            std::cout << "closing file..." << std::endl;
+            messages(opt) << "closing file..." << std::endl;
             pcap_dump_close(this->dumper);
         }
-
-        global::stop.store(true, std::memory_order_relaxed);
-        print_pcap_stats(this->in, id);
-        return 0;
+
+        global::stop.store(true, std::memory_order_relaxed);
+        print_pcap_stats(messages(opt), this->in, id);
+        return 0;
+    }
+
+    // read a batch of packets (copied, pcap_next_ex reuses its buffer),
+    // run the prefilter on the batch and hand the matching ones to the
+    // handler...
+    //
+
+    void
+    read_batched(options const &opt, prefilter::program const &prog, pcap_handler handler)
+    {
+        const size_t size = prefilter::batch::size;
+
+        std::unique_ptr<prefilter::batch> b(new prefilter::batch);
+        std::vector<u_char> data;
+        struct pcap_pkthdr hdr[size];
+        size_t off[size];
+
+        data.reserve(size * 2048);
+
+        auto stop = opt.count ? opt.count : std::numeric_limits<size_t>::max();
+        bool eof  = false;
+
+        for(size_t n = 0; !eof && n < stop && !global::stop.load(std::memory_order_relaxed); )
+        {
+            size_t k = 0;
+
+            data.clear();
+            for(; k < size; k++)
+            {
+                struct pcap_pkthdr *h;
+                const u_char *pkt;
+
+                auto ret = pcap_next_ex(this->in, &h, &pkt);
+                if (ret != 1) {
+                    if (ret == -1)
+                        std::cerr << "pcap_next_ex: " << pcap_geterr(this->in) << std::endl;
+                    eof = true;
+                    break;
+                }
+
+                hdr[k] = *h;
+                off[k] = data.size();
+                data.insert(data.end(), pkt, pkt + h->caplen);
+                b->extract(k, pkt, h->caplen);
+            }
+
+            b->eval(prog, k);
+
+            for(size_t i = 0; i < k && n < stop; i++)
+            {
+                if (!b->match[i])
+                    continue;
+                if (!opt.next || opt.rfilt.empty() || opt.rfilt(n))
+                    handler(reinterpret_cast<u_char *>(this), &hdr[i], data.data() + off[i]);
+                n++;
+            }
+        }
     }
 };
 
@@ -332,8 +1522,6 @@ struct pcap_top_live : public capthread
     int
     operator()(options const &opt, std::string const &filter)
     {
-        std::unique_lock<std::mutex> lock(global::syncout);
-
         bpf_program fcode;
 
         // set signal handlers...
@@ -342,10 +1530,11 @@ struct pcap_top_live : public capthread
         if (signal(SIGINT, set_stop) == SIG_ERR)
             throw std::runtime_error("signal");
 
-        // print header...
+        // header, printed at once: the threads are set up in parallel...
         //
 
-        std::cout << "listening on " << opt.in.ifname << ", snaplen " << opt.snaplen;
+        std::ostringstream header;
+        header << "listening on " << opt.in.ifname << ", snaplen " << opt.snaplen;
 
         // create a pcap handler
         //
@@ -362,21 +1551,25 @@ struct pcap_top_live : public capthread
         //
         if (opt.buffer_size)
         {
-            std::cout << ", buffer size " << opt.buffer_size;
+            header << ", buffer size " << opt.buffer_size;
             if ((status = pcap_set_buffer_size(this->in, opt.buffer_size)) != 0)
                 throw std::runtime_error(std::string("pcap_set_buffer_size: ") + pcap_geterr(this->in));
         }
 
-        if (opt.immediate)
+        // busy polling needs immediate mode: with TPACKET_V3 a block is
+        // only handed over once full or on the block timeout...
+        //
+
+        if (opt.immediate || opt.busy_poll)
         {
-            std::cout << ", imnediate";
+            header << ", imnediate";
             if ((status = pcap_set_immediate_mode(this->in, true)) != 0)
                 throw std::runtime_error(std::string("pcap_set_immediate_mode: ") + pcap_geterr(this->in));
         }
         
         if (opt.nonblock)
         {
-            std::cout << ", nonblock";
+            header << ", nonblock";
             if ((status = pcap_setnonblock(this->in, true, this->errbuf)) != 0)
                 throw std::runtime_error(std::string("pcap_setnonblock: ") + pcap_geterr(this->in));
         }
@@ -394,15 +1587,16 @@ struct pcap_top_live : public capthread
         // set timeout...
         //
 
-        std::cout << ", timeout " << opt.timeout << "_ms";
+        header << ", timeout " << opt.timeout << "_ms";
         if ((status = pcap_set_timeout(this->in, opt.timeout)) != 0)
         {
             throw std::runtime_error(std::string("pcap_set_timeout: ") + pcap_geterr(this->in));
         }
 
-        std::cout<< std::endl;
-
-        lock.unlock();
+        {
+            std::lock_guard<std::mutex> lock(global::syncout);
+            messages(opt) << header.str() << std::endl;
+        }
 
         // activate...
         //
@@ -416,6 +1610,28 @@ struct pcap_top_live : public capthread
             }
         }
 #endif
+        // one RX queue per thread: QM fanout delivers queue q to the q-th
+        // socket of the group (modulo the group size), so threads join in
+        // id order...
+        //
+        if (opt.rx_queues)
+        {
+            static std::atomic<int> turn(0);
+
+            while (turn.load(std::memory_order_acquire) != id)
+            {
+                if (global::stop.load(std::memory_order_relaxed))
+                    return 0;
+                std::this_thread::yield();
+            }
+
+            rxqueue::join_fanout(pcap_fileno(this->in), getpid() + static_cast<int>(iface));
+            turn.store(id + 1, std::memory_order_release);
+        }
+
+        if (opt.busy_poll && !busypoll::enable(this->in, static_cast<int>(opt.busy_poll)))
+            std::cerr << "warning: SO_PREFER_BUSY_POLL not supported, busy polling from the syscall only" << std::endl;
+
         // set BPF...
         //
         if (!filter.empty())
@@ -431,26 +1647,35 @@ struct pcap_top_live : public capthread
         //
 
         if (!opt.out.filename.empty())
-            pcap_top_inject_file(opt, id);
+            pcap_top_inject_file(opt, this);
 
         else if (!opt.out.ifname.empty())
-            pcap_top_inject_live(opt, id);
+            pcap_top_inject_live(opt, this);
 
         // run thread of stats
         //
 
-        auto packet_handler = get_packet_handler(opt);
+        if (this->flight)
+            this->flight->linktype = pcap_datalink(this->in);
+
+        auto packet_handler = instrument_handler(opt, this, get_packet_handler(opt, this));
+
+        global::arrive();
 
         // start capture...
         //
-        if (!opt.next)
+        if (this->busypoll)
+        {
+            busypoll::loop(this->in, opt.count, static_cast<int>(opt.timeout), packet_handler, reinterpret_cast<u_char*>(this), *this->busypoll);
+        }
+        else if (!opt.next)
         {
             if (pcap_loop(this->in, opt.count, packet_handler, reinterpret_cast<u_char*>(this)) == -1)
                 throw std::runtime_error("pcap_loop: " + std::string(pcap_geterr(this->in)));
         }
         else
         {
-            std::cout << "using pcap_next..." << std::endl;
+            messages(opt) << "using pcap_next..." << std::endl;
             auto stop = opt.count ? opt.count : std::numeric_limits<size_t>::max();
             for(size_t n = 0; n < stop; )
             {
@@ -468,7 +1693,7 @@ struct pcap_top_live : public capthread
         }
 
         global::stop.store(true, std::memory_order_relaxed);
-        print_pcap_stats(this->in, this->id);
+        print_pcap_stats(messages(opt), this->in, this->id);
         return 0;
     }
 
@@ -494,10 +1719,10 @@ struct pcap_top_gen : public capthread
             throw std::runtime_error("signal");
 
         if (!opt.out.filename.empty())
-            pcap_top_inject_file(opt, id);
+            pcap_top_inject_file(opt, this);
 
         else if (!opt.out.ifname.empty())
-            pcap_top_inject_live(opt, 0xdeadbeef);
+            pcap_top_inject_live(opt, this);
 
         // run thread of stats
         //
@@ -506,19 +1731,16 @@ struct pcap_top_gen : public capthread
 
         auto stop = opt.count ? opt.count : std::numeric_limits<size_t>::max();
 
-        std::mt19937 gen;
+        // every generator works on its own copy of the packet...
+        //
+
+        generator::frame frame(opt.rand_ip, opt.probe, static_cast<uint32_t>(id));
 
-        auto ip = reinterpret_cast<iphdr *>(global::default_packet + 14);
+        global::arrive();
 
         for(size_t n = 0; n < stop; n++)
         {
-                if (opt.rand_ip)
-                {
-                    ip->saddr = static_cast<uint32_t>(gen());
-                    ip->daddr = static_cast<uint32_t>(gen());
-                }
-
-                int ret = pcap_inject(this->out, global::default_packet, len);
+                int ret = pcap_inject(this->out, frame.next(n), len);
                 if (ret >= 0)
                 {
                     this->atomic_stat.out_count.fetch_add(1, std::memory_order_relaxed);
@@ -535,53 +1757,518 @@ struct pcap_top_gen : public capthread
 };
 
 
+//
+// pcap_top_null: packets replayed from memory into the same handler and
+// stats path as the live capture, at memory speed...
+//
+
+struct pcap_top_null : public capthread
+{
+    pcap_top_null(int i)
+    {
+        id = i;
+    }
+
+    int
+    operator()(options const &opt, std::string const &)
+    {
+        auto &t = *this->replay;
+
+        // a dead handle, for the dumper and the handlers that need one...
+        //
+
+        this->in = pcap_open_dead(DLT_EN10MB, static_cast<int>(opt.snaplen));
+
+        if (!opt.out.filename.empty())
+            pcap_top_inject_file(opt, this);
+
+        else if (!opt.out.ifname.empty())
+            pcap_top_inject_live(opt, this);
+
+        {
+            std::lock_guard<std::mutex> lock(global::syncout);
+            messages(opt) << "null device: " << t.size() << " packets (" << t.data.size() << " bytes) from "
+                          << (opt.in.filename.empty() ? std::string("the generator template") : opt.in.filename)
+                          << ", replayed in a loop" << std::endl;
+        }
+
+        auto packet_handler = instrument_handler(opt, this, get_packet_handler(opt, this));
+        auto user = reinterpret_cast<u_char *>(this);
+
+        global::arrive();
+
+        auto stop = opt.count ? opt.count : std::numeric_limits<size_t>::max();
+        size_t i = 0;
+
+        // the stop flag is checked once per batch...
+        //
+
+        for(size_t n = 0; n < stop && !global::stop.load(std::memory_order_relaxed); )
+        {
+            auto end = std::min<size_t>(stop - n, 256);
+            for(size_t k = 0; k < end; k++)
+            {
+                packet_handler(user, &t.hdr[i], &t.data[t.offset[i]]);
+                if (++i == t.size())
+                    i = 0;
+            }
+            n += end;
+        }
+
+        if (this->dumper)
+            pcap_dump_close(this->dumper);
+
+        global::stop.store(true, std::memory_order_relaxed);
+        return 0;
+    }
+};
+
+
+//
+// pcap_top_count: the packets are counted by the eBPF program attached in
+// thread_setup, the thread just keeps the socket alive...
+//
+
+struct pcap_top_count : public capthread
+{
+    pcap_top_count(int i)
+    {
+        id = i;
+    }
+
+    int
+    operator()(options const &opt, std::string const &filter)
+    {
+        {
+            std::lock_guard<std::mutex> lock(global::syncout);
+            messages(opt) << "counting on " << opt.in.ifname << " with an eBPF socket filter"
+                          << (filter.empty() ? "" : ": " + filter) << " (no packet is copied)" << std::endl;
+        }
+
+        global::arrive();
+
+        while (!global::stop.load(std::memory_order_relaxed))
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        return 0;
+    }
+};
+
+
+//
+// bridge: thread #0 forwards in -> out, thread #1 out -> in. Frames are
+// copied from the RX ring of one side into the TX ring of the other, the
+// TX ring is flushed once per batch...
+//
+
+struct pcap_top_bridge : public capthread
+{
+    pcap_top_bridge(int i)
+    {
+        id = i;
+    }
+
+    int
+    operator()(options const &opt, std::string const &filter)
+    {
+        static constexpr size_t batch = 64;
+
+        auto bytes = opt.buffer_size ? opt.buffer_size : (8 << 20);
+
+        // the BPF expression selects the packets forwarded...
+        //
+
+        bpf_program fcode;
+
+        if (!filter.empty())
+        {
+            auto dead = pcap_open_dead(DLT_EN10MB, 65535);
+            if (pcap_compile(dead, &fcode, filter.c_str(), opt.oflag, PCAP_NETMASK_UNKNOWN) < 0) {
+                std::string err = pcap_geterr(dead);
+                pcap_close(dead);
+                throw std::runtime_error("pcap_compile: " + err);
+            }
+            pcap_close(dead);
+        }
+
+        ring::rx from(opt.in.ifname, bytes, filter.empty() ? nullptr : &fcode);
+        ring::tx to(opt.out.ifname, bytes);
+
+        if (!filter.empty())
+            pcap_freecode(&fcode);
+
+        {
+            std::lock_guard<std::mutex> lock(global::syncout);
+            messages(opt) << "bridging " << opt.in.ifname << " -> " << opt.out.ifname
+                          << ", rings " << from.frames << " x " << from.frame_size << " bytes" << std::endl;
+        }
+
+        if (from.gro)
+            std::cerr << "warning: GRO is on for " << opt.in.ifname << ", merged frames larger than " << from.frame_size
+                      << " bytes are counted as truncated (ethtool -K " << opt.in.ifname << " gro off)" << std::endl;
+
+        global::arrive();
+
+        auto &m = *this->ring;
+        auto stop = opt.count ? opt.count : std::numeric_limits<size_t>::max();
+        size_t total = 0;
+        uint64_t batches = 0;
+
+        while (total < stop && !global::stop.load(std::memory_order_relaxed))
+        {
+            size_t n = 0, fwd = 0, fail = 0, full = 0, trunc = 0;
+            uint64_t in_band = 0, out_band = 0;
+
+            for(; n < batch; n++)
+            {
+                auto h = from.next();
+                if (!h)
+                    break;
+
+                in_band += h->tp_len;
+
+                if (unlikely(h->tp_snaplen < h->tp_len))
+                {
+                    trunc++;
+                    fail++;
+                }
+                else
+                {
+                    auto len = ring::rx::length(h);
+                    auto p = to.slot(len);
+                    if (unlikely(p == nullptr))
+                    {
+                        // TX ring full: kick the pending frames and retry once...
+                        full++;
+                        to.flush();
+                        p = to.slot(len);
+                    }
+
+                    if (p)
+                    {
+                        from.copy(h, p);
+                        to.commit(len);
+                        out_band += len;
+                        fwd++;
+                    }
+                    else
+                        fail++;
+                }
+
+                from.release();
+            }
+
+            to.flush();
+
+            if (n)
+            {
+                total += n;
+                atomic_stat.in_count .fetch_add(n, std::memory_order_relaxed);
+                atomic_stat.in_band  .fetch_add(in_band, std::memory_order_relaxed);
+                atomic_stat.out_count.fetch_add(fwd, std::memory_order_relaxed);
+                atomic_stat.out_band .fetch_add(out_band, std::memory_order_relaxed);
+                if (fail)
+                    atomic_stat.fail .fetch_add(fail, std::memory_order_relaxed);
+                if (full)
+                    m.add(m.full, full);
+                if (trunc)
+                    m.add(m.truncated, trunc);
+            }
+
+            if (n == 0 || (++batches & 1023) == 0)
+                m.add(m.kdrop, from.drops());
+
+            if (n == 0)
+                from.wait(static_cast<int>(opt.timeout));
+        }
+
+        global::stop.store(true, std::memory_order_relaxed);
+        return 0;
+    }
+};
+
+
+template <typename Thread>
+static void
+spawn_thread(size_t n, size_t core, options const &opt, std::string const &filter, size_t iface = 0)
+{
+    // context and meters are allocated (and touched) on the node of the
+    // core. The thread is created there too: it inherits the affinity, so
+    // the ring it allocates is local from the start...
+    //
+
+    topology::local_scope local(core);
+
+    auto ctx = new Thread(n);
+    ctx->iface = iface;
+    global::thread_ctx.push_back(std::unique_ptr<capthread>(ctx));
+
+    thread_setup(ctx, opt, filter);
+
+    std::thread t(std::ref(*ctx), opt, filter);
+    thread_affinity(t, core);
+    global::thread.push_back(std::move(t));
+    global::cores.push_back(core);
+}
+
+
+//
+// capture cores: --cores, --first-core, or placed on the node of the
+// interface (skipping the cores taken by the other thread groups)...
+//
+
+static std::vector<size_t>
+thread_cores(options const &opt, size_t nthreads, std::vector<size_t> const &taken = {})
+{
+    auto nic = !opt.in.ifname.empty() ? opt.in.ifname : opt.out.ifname;
+
+    auto free_cores = [&] (size_t n) {
+        auto ret = topology::place(n + taken.size(), nic);
+        ret.erase(std::remove_if(ret.begin(), ret.end(), [&] (size_t c) {
+                    return std::find(taken.begin(), taken.end(), c) != taken.end(); }), ret.end());
+        return ret.size() < n ? topology::place(n, nic) : ret;    // oversubscribed: share
+    };
+
+    std::vector<size_t> cores;
+
+    if (!opt.cores.empty())
+        cores = opt.cores;
+    else if (opt.rx_queues)
+    {
+        // the core servicing the IRQ of each queue, or placed if unknown...
+        //
+
+        auto n = rxqueue::count(opt.in.ifname);
+        if (n != nthreads)
+            std::cerr << "warning: " << opt.in.ifname << " has " << n << " RX queues, " << nthreads << " threads" << std::endl;
+
+        auto irqs  = rxqueue::irqs(opt.in.ifname, nthreads);
+        auto place = free_cores(nthreads);
+
+        for(size_t q = 0; q < nthreads; q++)
+        {
+            auto c = rxqueue::irq_core(irqs[q]);
+            if (c < 0)
+                std::cerr << "warning: IRQ of rx-" << q << " not found, thread #" << q << " placed on core " << place[q] << std::endl;
+            cores.push_back(c < 0 ? place[q] : static_cast<size_t>(c));
+        }
+    }
+    else if (opt.firstcore != ~size_t(0))
+        for(size_t n = 0; n < nthreads; n++)
+            cores.push_back(opt.firstcore + n);
+    else
+        cores = free_cores(nthreads);
+
+    if (cores.size() < nthreads)
+        throw std::runtime_error("--cores: " + std::to_string(cores.size()) + " cores for " + std::to_string(nthreads) + " threads");
+
+    cores.resize(nthreads);
+    topology::check(cores, nic);
+    return cores;
+}
+
+
 int
 pcap_top(options const &opt, std::string const &filter)
 {
     if (signal(SIGINT, set_stop) == SIG_ERR)
             throw std::runtime_error("signal SIGINT");
 
-    for(size_t n = 0; n < opt.numthread; n++)
+    if (opt.flight.size && signal(SIGUSR1, flight::request) == SIG_ERR)
+            throw std::runtime_error("signal SIGUSR1");
+
+    if (opt.rx_queues && (opt.in.ifname.empty() || opt.probe || opt.count_only))
+        throw std::runtime_error("--rx-queues requires live capture on an input interface");
+
+#ifdef PCAP_VERSION_FANOUT
+    // --rx-queues puts the sockets in a PACKET_FANOUT_QM group: a socket
+    // cannot join a second one...
+    //
+
+    if (opt.rx_queues && (!opt.fanout.empty() || std::any_of(opt.interfaces.begin(), opt.interfaces.end(),
+                                                             [] (options::interface const &i) { return !i.fanout.empty(); })))
+        throw std::runtime_error("--rx-queues and --fanout are mutually exclusive");
+#endif
+
+    if (opt.flight.size && (opt.count_only || opt.bridge || opt.probe || (opt.in.ifname.empty() && opt.in.filename.empty() && !opt.null_device)))
+        throw std::runtime_error("--flight requires a capture: live, from file or null device");
+
+    // the recorder is fed by the default handler, a handler of -H replaces it...
+    //
+
+    if (opt.flight.size && !opt.handler.empty())
+        throw std::runtime_error("--flight records with the default handler only (not with -H)");
+
+    if (!opt.interfaces.empty() && (opt.in.ifname.empty() || opt.probe || opt.count_only || opt.bridge || !opt.out.ifname.empty() || !opt.out.filename.empty()))
+        throw std::runtime_error("several interfaces: live capture only");
+
+    // sweep: a sequence of trials, no stats thread...
+    //
+
+    if (!opt.sweep.sizes.empty())
     {
-        std::unique_ptr<capthread> t(
+        sweep::print(sweep::run(opt, filter, thread_cores(opt, 2)));
+        return 0;
+    }
 
-            [&] () -> capthread * {
+    // the record writer is opened here, so that errors are reported
+    // before any thread starts...
+    //
 
-            if (!opt.in.filename.empty()) {
-                auto ctx = new pcap_top_file(n);
-                std::thread t(std::ref(*ctx), opt, filter);
-                thread_affinity(t, opt.firstcore + n);
-                global::thread.push_back(std::move(t));
-                return ctx;
-            }
-            if (!opt.in.ifname.empty()) {
-                auto ctx = new pcap_top_live(n);
-                std::thread t(std::ref(*ctx), opt, filter);
-                thread_affinity(t, opt.firstcore + n);
-                global::thread.push_back(std::move(t));
-                return ctx;
-            }
+    std::unique_ptr<record_writer> writer;
+
+    if (!opt.stats.format.empty() || !opt.stats.file.empty())
+        writer = record_writer::make(opt.stats.format.empty() ? "json" : opt.stats.format, opt.stats.file);
+
+    auto stats_opt = opt;
+
+    if (opt.probe)
+    {
+        // probe mode: thread #0 captures and decodes probes on the input
+        // interface, threads #1..N generate one stream each...
+        //
+
+        if (opt.in.ifname.empty() || opt.out.ifname.empty())
+            throw std::runtime_error("probe mode requires both input and output interfaces");
+
+        if (opt.genlen < probe::min_len)
+            throw std::runtime_error("probe mode requires genlen >= " + std::to_string(probe::min_len));
+
+        auto rx_opt = opt;
+        auto tx_opt = opt;
+
+        rx_opt.out.ifname.clear();
+        tx_opt.in.ifname.clear();
+
+        auto cores = thread_cores(opt, opt.numthread + 1);
+
+        spawn_thread<pcap_top_live>(0, cores[0], rx_opt, filter);
+
+        for(size_t n = 1; n <= opt.numthread; n++)
+            spawn_thread<pcap_top_gen>(n, cores[n], tx_opt, filter);
+
+        stats_opt.numthread = opt.numthread + 1;
+    }
+    else if (opt.null_device)
+    {
+        auto cores = thread_cores(opt, opt.numthread);
+
+        for(size_t n = 0; n < opt.numthread; n++)
+            spawn_thread<pcap_top_null>(n, cores[n], opt, filter);
+    }
+    else if (opt.bridge)
+    {
+        if (opt.in.ifname.empty() || opt.out.ifname.empty())
+            throw std::runtime_error("bridge mode requires both input and output interfaces");
+
+        auto back = opt;
+        std::swap(back.in.ifname, back.out.ifname);
+
+        auto cores = thread_cores(opt, 2);
+
+        spawn_thread<pcap_top_bridge>(0, cores[0], opt, filter);
+        spawn_thread<pcap_top_bridge>(1, cores[1], back, filter);
+
+        stats_opt.numthread = 2;
+    }
+    else if (opt.count_only)
+    {
+        // one socket is enough: the program runs on the CPU that receives
+        // the packet and the counters are per-CPU...
+        //
+
+        if (opt.in.ifname.empty())
+            throw std::runtime_error("count-only mode requires an input interface");
+
+        spawn_thread<pcap_top_count>(0, thread_cores(opt, 1)[0], opt, filter);
+    }
+    else if (!opt.interfaces.empty())
+    {
+        // one thread group per interface, numbered in sequence and sharing
+        // the stats thread...
+        //
+
+        std::vector<size_t> taken;
+        size_t n = 0;
 
-            if (!opt.out.ifname.empty() || !opt.out.filename.empty()) {
-                auto ctx = new pcap_top_gen(n);
-                std::thread t(std::ref(*ctx), opt, filter);
-                thread_affinity(t, opt.firstcore + n);
-                global::thread.push_back(std::move(t));
-                return ctx;
+        for(size_t g = 0; g <= opt.interfaces.size(); g++)
+        {
+            auto gopt   = opt;
+            auto gfilt  = filter;
+
+            if (g > 0)
+            {
+                auto &i = opt.interfaces[g-1];
+                gopt.in.ifname  = i.ifname;
+                gopt.numthread  = i.numthread;
+                gopt.cores      = i.cores;
+                gopt.firstcore  = ~size_t(0);
+#ifdef PCAP_VERSION_FANOUT
+                gopt.group      = i.group;
+                gopt.fanout     = i.fanout;
+#endif
+                if (!i.bpf.empty())
+                    gfilt = i.bpf;
             }
 
-            throw std::runtime_error("interface/filename missing");
+            auto cores = thread_cores(gopt, gopt.numthread, taken);
+
+            for(size_t k = 0; k < gopt.numthread; k++, n++)
+                spawn_thread<pcap_top_live>(n, cores[k], gopt, gfilt, g);
 
-            }()
-        );
+            taken.insert(taken.end(), cores.begin(), cores.end());
+        }
 
-        global::thread_ctx.push_back(std::move(t));
+        stats_opt.numthread = n;
     }
-    
+    else
+    {
+        auto cores = thread_cores(opt, opt.numthread);
+
+        for(size_t n = 0; n < opt.numthread; n++)
+        {
+            if (!opt.in.filename.empty())
+                spawn_thread<pcap_top_file>(n, cores[n], opt, filter);
+
+            else if (!opt.in.ifname.empty())
+                spawn_thread<pcap_top_live>(n, cores[n], opt, filter);
+
+            else if (!opt.out.ifname.empty() || !opt.out.filename.empty())
+                spawn_thread<pcap_top_gen>(n, cores[n], opt, filter);
+
+            else
+                throw std::runtime_error("interface/filename missing");
+        }
+    }
+
     for(auto &t : global::thread)
        t.detach();
 
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // live stats for external monitors (shared memory): one record per
+    // thread, created before the threads are released...
+    //
+
+    std::unique_ptr<shm::publisher> shmem;
+
+    if (!opt.stats.shm.empty())
+    {
+        try {
+            shmem.reset(new shm::publisher(opt.stats.shm, global::thread_ctx.size()));
+        }
+        catch(...) {
+            global::stop.store(true, std::memory_order_relaxed);
+            throw;
+        }
+    }
+
+    // the threads set up in parallel: release them together once all of
+    // them are ready to capture...
+    //
+
+    while (global::ready.load(std::memory_order_acquire) < global::thread_ctx.size() && !global::stop.load(std::memory_order_relaxed))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    global::start.store(true, std::memory_order_release);
 
     auto stat = [&] () -> pcap_t *{
         for(auto &c : global::thread_ctx) {
@@ -592,7 +2279,8 @@ pcap_top(options const &opt, std::string const &filter)
         return nullptr;
     }();
     
-    std::thread s(thread_stats, opt, stat);
+    std::thread s(thread_stats, stats_opt, stat, std::move(writer), std::move(shmem));
+    thread_affinity_except(s, global::cores);
     s.join();
 
     return 0;
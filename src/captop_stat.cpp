@@ -0,0 +1,158 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+//
+// captop-stat: poll the live stats segment published by captop --shm NAME
+//
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+
+#include <shmstats.hpp>
+#include <util.hpp>
+
+
+namespace
+{
+    std::string name = "captop-stat";
+}
+
+
+void usage()
+{
+    std::cerr << "usage: " + name + " [OPTIONS] NAME\n\n"
+                 "  -i --interval USEC           Polling interval (default 1000000).\n"
+                 "  -c count                     Exit after count samples.\n"
+                 "  -? --help                    Print this help.\n";
+    _Exit(0);
+}
+
+
+void print(const char *id, shm::counters const &c)
+{
+    std::cout << std::setw(4) << id << "| ";
+    std::cout << " packets: "  << highlight(c.in_count)      << '(' << highlight(c.in_pps) << " pps)";
+    std::cout << " in-band: "  << highlight(pretty(c.in_bps))  << "bit/sec";
+    std::cout << " injected: " << highlight(c.out_count)     << '(' << highlight(c.out_pps) << " pps)";
+    std::cout << " fail: "     << highlight(c.fail)          << '(' << highlight(c.fail_ps) << "/sec)";
+    std::cout << " out-band: " << highlight(pretty(c.out_bps)) << "bit/sec";
+}
+
+
+int
+main(int argc, char *argv[])
+try
+{
+    size_t interval = 1000000, count = 0;
+    std::string segment;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if ( any_strcmp(argv[i], "-i", "--interval") ) {
+            if (++i == argc)
+                throw std::runtime_error("interval missing");
+            interval = static_cast<size_t>(std::atoll(argv[i]));
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "-c") ) {
+            if (++i == argc)
+                throw std::runtime_error("count missing");
+            count = static_cast<size_t>(std::atoll(argv[i]));
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "-h", "-?", "--help") )
+            usage();
+
+        segment = argv[i][0] == '/' ? argv[i] : std::string("/") + argv[i];
+    }
+
+    if (segment.empty())
+        usage();
+
+    int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+    if (fd == -1)
+        throw std::runtime_error("shm_open " + segment + ": " + strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(shm::header))
+        throw std::runtime_error(segment + ": invalid segment");
+
+    auto addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        throw std::runtime_error("mmap " + segment + ": " + strerror(errno));
+
+    auto hdr = static_cast<shm::header *>(addr);
+
+    if (hdr->magic != shm::magic)
+        throw std::runtime_error(segment + ": bad magic");
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (hdr->version != shm::version)
+        throw std::runtime_error(segment + ": unsupported version " + std::to_string(hdr->version));
+
+    if (hdr->header_size + static_cast<size_t>(hdr->nthreads) * hdr->record_size > static_cast<size_t>(st.st_size))
+        throw std::runtime_error(segment + ": truncated segment");
+
+    std::cout << segment << ": captop pid " << hdr->pid << ", " << hdr->nthreads << " threads" << std::endl;
+
+    uint64_t last = ~0ull;
+
+    for(size_t n = 0; count == 0 || n < count; std::this_thread::sleep_for(std::chrono::microseconds(interval)))
+    {
+        auto g = shm::read(hdr->seq, hdr->data);
+        if (g.updates == last)
+            continue;
+        last = g.updates;
+        n++;
+
+        char id[24];
+        for(uint32_t i = 0; i < hdr->nthreads; i++)
+        {
+            auto r = shm::record(hdr, i);
+            snprintf(id, sizeof(id), "#%u", r->id);
+            print(id, shm::read(r->seq, r->data));
+            std::cout << '\n';
+        }
+
+        print("TOT", g.total);
+        std::cout << " drop: " << highlight(g.drop_ps) << " pps, ifdrop: " << highlight(g.ifdrop_ps) << " pps" << std::endl;
+    }
+
+    return 0;
+}
+catch(std::exception &e)
+{
+    std::cerr << name << ": " << e.what() << std::endl;
+    return 1;
+}
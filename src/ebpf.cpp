@@ -0,0 +1,495 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <ebpf.hpp>
+#include <prefilter.hpp>
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+
+
+namespace ebpf
+{
+    namespace
+    {
+        int sys_bpf(int cmd, union bpf_attr &attr)
+        {
+            return static_cast<int>(syscall(__NR_bpf, cmd, &attr, sizeof(attr)));
+        }
+
+        size_t possible_cpus()
+        {
+            // e.g. "0-63"...
+            std::ifstream in("/sys/devices/system/cpu/possible");
+            std::string s;
+            if (!(in >> s))
+                throw std::runtime_error("ebpf: cannot read the number of possible CPUs");
+
+            auto dash = s.find_last_of("-,");
+            return std::stoul(dash == std::string::npos ? s : s.substr(dash + 1)) + 1;
+        }
+
+        enum reg { r0, r1, r2, r3, r4, r5, r6, r7, r8, r9, fp };
+
+        //
+        // a minimal eBPF assembler with forward labels...
+        //
+
+        struct assembler
+        {
+            int label()
+            {
+                target.push_back(-1);
+                return static_cast<int>(target.size() - 1);
+            }
+
+            void bind(int l)
+            {
+                target[l] = static_cast<int>(code.size());
+            }
+
+            void emit(uint8_t op, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+            {
+                struct bpf_insn i;
+                memset(&i, 0, sizeof(i));
+                i.code    = op;
+                i.dst_reg = dst & 0xf;
+                i.src_reg = src & 0xf;
+                i.off     = off;
+                i.imm     = imm;
+                code.push_back(i);
+            }
+
+            void mov(uint8_t dst, uint8_t src)      { emit(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0); }
+            void mov_imm(uint8_t dst, int32_t imm)  { emit(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm); }
+            void mov32_imm(uint8_t dst, uint32_t v) { emit(BPF_ALU | BPF_MOV | BPF_K, dst, 0, 0, static_cast<int32_t>(v)); }
+            void alu_imm(uint8_t op, uint8_t dst, int32_t imm) { emit(BPF_ALU64 | op | BPF_K, dst, 0, 0, imm); }
+            void add(uint8_t dst, uint8_t src)      { emit(BPF_ALU64 | BPF_ADD | BPF_X, dst, src, 0, 0); }
+
+            // packet loads (host order); past the end the program returns 0...
+            void ld_abs(uint8_t size, int32_t off)  { emit(BPF_LD | BPF_ABS | size, 0, 0, 0, off); }
+            void ld_ind(uint8_t size, uint8_t src, int32_t off) { emit(BPF_LD | BPF_IND | size, 0, src, 0, off); }
+
+            void ldx(uint8_t size, uint8_t dst, uint8_t src, int16_t off) { emit(BPF_LDX | BPF_MEM | size, dst, src, off, 0); }
+            void stx(uint8_t size, uint8_t dst, uint8_t src, int16_t off) { emit(BPF_STX | BPF_MEM | size, dst, src, off, 0); }
+            void st(uint8_t size, uint8_t dst, int16_t off, int32_t imm)  { emit(BPF_ST | BPF_MEM | size, dst, 0, off, imm); }
+
+            void jmp_imm(uint8_t op, uint8_t dst, int32_t imm, int l) { fixup.emplace_back(code.size(), l); emit(BPF_JMP | op | BPF_K, dst, 0, 0, imm); }
+            void jmp_reg(uint8_t op, uint8_t dst, uint8_t src, int l) { fixup.emplace_back(code.size(), l); emit(BPF_JMP | op | BPF_X, dst, src, 0, 0); }
+            void ja(int l) { fixup.emplace_back(code.size(), l); emit(BPF_JMP | BPF_JA, 0, 0, 0, 0); }
+
+            void ld_map(uint8_t dst, int fd)
+            {
+                emit(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd);
+                emit(0, 0, 0, 0, 0);
+            }
+
+            void call(int32_t fun)  { emit(BPF_JMP | BPF_CALL, 0, 0, 0, fun); }
+            void exit()             { emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0); }
+
+            std::vector<struct bpf_insn> const &finish()
+            {
+                for(auto &f : fixup)
+                    code[f.first].off = static_cast<int16_t>(target[f.second] - static_cast<int>(f.first) - 1);
+                return code;
+            }
+
+            std::vector<struct bpf_insn> code;
+            std::vector<int> target;
+            std::vector<std::pair<size_t, int>> fixup;
+        };
+
+
+        void gen_port_proto(assembler &a, int drop)
+        {
+            auto ok = a.label();
+            a.jmp_imm(BPF_JEQ, r8, IPPROTO_TCP, ok);
+            a.jmp_imm(BPF_JEQ, r8, IPPROTO_UDP, ok);
+            a.jmp_imm(BPF_JEQ, r8, IPPROTO_SCTP, ok);
+            a.ja(drop);
+            a.bind(ok);
+        }
+
+
+        // IPv4: protocol, addresses, then ports of the first fragment...
+        //
+
+        void gen_ip4(assembler &a, prefilter::program const &p, int drop, int count, int v4)
+        {
+            a.bind(v4);
+            a.ld_abs(BPF_B, 23);
+            a.mov(r8, r0);
+
+            if (!p.protos.empty())
+            {
+                auto ok = a.label();
+                for(auto x : p.protos)
+                    a.jmp_imm(BPF_JEQ, r8, static_cast<int32_t>(x), ok);
+                a.ja(drop);
+                a.bind(ok);
+            }
+
+            for(auto &x : p.addrs)
+            {
+                auto ok = a.label();
+                for(int off : { 26, 30 })
+                {
+                    if ((off == 26 && x.d == prefilter::destination) || (off == 30 && x.d == prefilter::source))
+                        continue;
+                    a.ld_abs(BPF_W, off);
+                    a.alu_imm(BPF_AND, r0, static_cast<int32_t>(x.mask));
+                    a.mov32_imm(r1, x.net);
+                    a.jmp_reg(BPF_JEQ, r0, r1, ok);
+                }
+                a.ja(drop);
+                a.bind(ok);
+            }
+
+            if (!p.ports.empty())
+            {
+                gen_port_proto(a, drop);
+
+                a.ld_abs(BPF_H, 20);
+                a.alu_imm(BPF_AND, r0, 0x1fff);
+                a.jmp_imm(BPF_JNE, r0, 0, drop);
+
+                a.ld_abs(BPF_B, 14);
+                a.alu_imm(BPF_AND, r0, 0xf);
+                a.alu_imm(BPF_LSH, r0, 2);
+                a.mov(r9, r0);
+
+                for(auto &x : p.ports)
+                {
+                    auto ok = a.label();
+                    if (x.d != prefilter::destination) {
+                        a.ld_ind(BPF_H, r9, 14);
+                        a.jmp_imm(BPF_JEQ, r0, static_cast<int32_t>(x.value), ok);
+                    }
+                    if (x.d != prefilter::source) {
+                        a.ld_ind(BPF_H, r9, 16);
+                        a.jmp_imm(BPF_JEQ, r0, static_cast<int32_t>(x.value), ok);
+                    }
+                    a.ja(drop);
+                    a.bind(ok);
+                }
+            }
+
+            a.ja(count);
+        }
+
+
+        // IPv6: the nexthdr of a fragment header counts as protocol...
+        //
+
+        void gen_ip6(assembler &a, prefilter::program const &p, int drop, int count, int v6)
+        {
+            a.bind(v6);
+            a.ld_abs(BPF_B, 20);
+            a.mov(r8, r0);
+
+            if (!p.protos.empty())
+            {
+                auto ok = a.label();
+                for(auto x : p.protos)
+                    a.jmp_imm(BPF_JEQ, r8, static_cast<int32_t>(x), ok);
+                a.jmp_imm(BPF_JNE, r8, 44, drop);
+                a.ld_abs(BPF_B, 54);
+                for(auto x : p.protos)
+                    a.jmp_imm(BPF_JEQ, r0, static_cast<int32_t>(x), ok);
+                a.ja(drop);
+                a.bind(ok);
+            }
+
+            if (!p.ports.empty())
+            {
+                gen_port_proto(a, drop);
+
+                for(auto &x : p.ports)
+                {
+                    auto ok = a.label();
+                    if (x.d != prefilter::destination) {
+                        a.ld_abs(BPF_H, 54);
+                        a.jmp_imm(BPF_JEQ, r0, static_cast<int32_t>(x.value), ok);
+                    }
+                    if (x.d != prefilter::source) {
+                        a.ld_abs(BPF_H, 56);
+                        a.jmp_imm(BPF_JEQ, r0, static_cast<int32_t>(x.value), ok);
+                    }
+                    a.ja(drop);
+                    a.bind(ok);
+                }
+            }
+
+            a.ja(count);
+        }
+
+
+        // r8 is set to the IP protocol (255 if not IP); on failure jump
+        // to drop...
+        //
+
+        void gen_filter(assembler &a, prefilter::program const *prog, int drop, int count)
+        {
+            auto v4 = a.label(), v6 = a.label();
+
+            a.mov_imm(r8, 255);
+
+            // no filter: everything counts, short frames included...
+            //
+
+            if (!prog)
+            {
+                a.jmp_imm(BPF_JLT, r7, 24, count);
+                a.ld_abs(BPF_H, 12);
+                a.jmp_imm(BPF_JEQ, r0, 0x0800, v4);
+                a.jmp_imm(BPF_JEQ, r0, 0x86dd, v6);
+                a.ja(count);
+                a.bind(v4);
+                a.ld_abs(BPF_B, 23);
+                a.mov(r8, r0);
+                a.ja(count);
+                a.bind(v6);
+                a.ld_abs(BPF_B, 20);
+                a.mov(r8, r0);
+                a.ja(count);
+                return;
+            }
+
+            auto &p = *prog;
+
+            // the verifier rejects unreachable code: generate only the
+            // branches the expression can take...
+            //
+
+            bool ip4 = p.l3 != 6;
+            bool ip6 = p.l3 != 4 && p.addrs.empty();
+
+            a.ld_abs(BPF_H, 12);
+            if (ip4)
+                a.jmp_imm(BPF_JEQ, r0, 0x0800, v4);
+            if (ip6)
+                a.jmp_imm(BPF_JEQ, r0, 0x86dd, v6);
+            a.ja(drop);
+
+            if (ip4)
+                gen_ip4(a, p, drop, count, v4);
+            if (ip6)
+                gen_ip6(a, p, drop, count, v6);
+        }
+
+
+        // counters[key] += (1, len), key in the stack slot at fp-4...
+        //
+
+        void gen_add(assembler &a, int map_fd, int out)
+        {
+            a.ld_map(r1, map_fd);
+            a.mov(r2, fp);
+            a.alu_imm(BPF_ADD, r2, -4);
+            a.call(BPF_FUNC_map_lookup_elem);
+            a.jmp_imm(BPF_JEQ, r0, 0, out);
+            a.ldx(BPF_DW, r1, r0, 0);
+            a.alu_imm(BPF_ADD, r1, 1);
+            a.stx(BPF_DW, r0, r1, 0);
+            a.ldx(BPF_DW, r1, r0, 8);
+            a.add(r1, r7);
+            a.stx(BPF_DW, r0, r1, 8);
+        }
+
+
+        std::vector<struct bpf_insn>
+        generate(prefilter::program const *prog, int map_fd)
+        {
+            assembler a;
+
+            auto drop  = a.label();
+            auto count = a.label();
+            auto out   = a.label();
+
+            a.mov(r6, r1);
+            a.ldx(BPF_W, r7, r6, offsetof(struct __sk_buff, len));
+
+            gen_filter(a, prog, drop, count);
+
+            a.bind(count);
+            a.st(BPF_W, fp, -4, total);
+            gen_add(a, map_fd, out);
+
+            auto set = a.label(), not_tcp = a.label(), not_udp = a.label(), is_icmp = a.label();
+
+            a.mov_imm(r9, other);
+            a.jmp_imm(BPF_JNE, r8, IPPROTO_TCP, not_tcp);
+            a.mov_imm(r9, tcp);
+            a.ja(set);
+            a.bind(not_tcp);
+            a.jmp_imm(BPF_JNE, r8, IPPROTO_UDP, not_udp);
+            a.mov_imm(r9, udp);
+            a.ja(set);
+            a.bind(not_udp);
+            a.jmp_imm(BPF_JEQ, r8, IPPROTO_ICMP, is_icmp);
+            a.jmp_imm(BPF_JNE, r8, IPPROTO_ICMPV6, set);
+            a.bind(is_icmp);
+            a.mov_imm(r9, icmp);
+            a.bind(set);
+            a.stx(BPF_W, fp, r9, -4);
+            gen_add(a, map_fd, out);
+
+            // nothing is queued to the socket...
+            //
+
+            a.bind(out);
+            a.bind(drop);
+            a.mov_imm(r0, 0);
+            a.exit();
+
+            return a.finish();
+        }
+    }
+
+
+    count_filter::count_filter(std::string const &ifname, std::string const &filter)
+    : sock(-1), map_fd(-1), prog_fd(-1), ncpu(possible_cpus())
+    {
+        prefilter::program prog;
+        if (!filter.empty() && !prefilter::compile(filter, prog))
+            throw std::runtime_error("count-only: filter not supported (use ip, ip6, tcp, udp, sctp, icmp, host, net, port): " + filter);
+
+        union bpf_attr attr;
+
+        // per-CPU counters...
+        //
+
+        memset(&attr, 0, sizeof(attr));
+        attr.map_type    = BPF_MAP_TYPE_PERCPU_ARRAY;
+        attr.key_size    = sizeof(uint32_t);
+        attr.value_size  = sizeof(counter);
+        attr.max_entries = slots;
+
+        if ((map_fd = sys_bpf(BPF_MAP_CREATE, attr)) < 0)
+            throw std::runtime_error(std::string("count-only: BPF_MAP_CREATE: ") + strerror(errno));
+
+        // program...
+        //
+
+        auto code = generate(filter.empty() ? nullptr : &prog, map_fd);
+
+        std::vector<char> log(65536);
+        const char license[] = "GPL";
+
+        memset(&attr, 0, sizeof(attr));
+        attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+        attr.insn_cnt  = static_cast<uint32_t>(code.size());
+        attr.insns     = reinterpret_cast<uint64_t>(code.data());
+        attr.license   = reinterpret_cast<uint64_t>(license);
+        attr.log_buf   = reinterpret_cast<uint64_t>(log.data());
+        attr.log_size  = static_cast<uint32_t>(log.size());
+        attr.log_level = 1;
+
+        if ((prog_fd = sys_bpf(BPF_PROG_LOAD, attr)) < 0) {
+            auto err = errno;
+            close(map_fd);
+            throw std::runtime_error(std::string("count-only: BPF_PROG_LOAD: ") + strerror(err) + '\n' + log.data());
+        }
+
+        // packet socket bound to the interface...
+        //
+
+        auto cleanup = [&] (std::string const &what) {
+            auto err = errno;
+            if (sock != -1)
+                close(sock);
+            close(prog_fd);
+            close(map_fd);
+            throw std::runtime_error("count-only: " + what + ": " + strerror(err));
+        };
+
+        // protocol 0: the socket sees no packet until it is bound...
+        //
+
+        if ((sock = socket(AF_PACKET, SOCK_RAW, 0)) < 0)
+            cleanup("socket");
+
+        struct sockaddr_ll sll;
+        memset(&sll, 0, sizeof(sll));
+        sll.sll_family   = AF_PACKET;
+        sll.sll_protocol = htons(ETH_P_ALL);
+        sll.sll_ifindex  = static_cast<int>(if_nametoindex(ifname.c_str()));
+
+        if (sll.sll_ifindex == 0)
+            cleanup(ifname);
+
+        // attach before binding (to the interface, with ETH_P_ALL), so that
+        // the program counts the packets of ifname only...
+        //
+
+        if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_BPF, &prog_fd, sizeof(prog_fd)) < 0)
+            cleanup("SO_ATTACH_BPF");
+
+        if (bind(sock, reinterpret_cast<struct sockaddr *>(&sll), sizeof(sll)) < 0)
+            cleanup("bind");
+    }
+
+
+    count_filter::~count_filter()
+    {
+        close(sock);
+        close(prog_fd);
+        close(map_fd);
+    }
+
+
+    counters
+    count_filter::read() const
+    {
+        counters ret;
+        std::vector<counter> percpu(ncpu);
+
+        for(uint32_t k = 0; k < slots; k++)
+        {
+            union bpf_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.map_fd = static_cast<uint32_t>(map_fd);
+            attr.key    = reinterpret_cast<uint64_t>(&k);
+            attr.value  = reinterpret_cast<uint64_t>(percpu.data());
+
+            ret.slot[k] = counter{0, 0};
+            if (sys_bpf(BPF_MAP_LOOKUP_ELEM, attr) < 0)
+                continue;
+
+            for(auto &c : percpu) {
+                ret.slot[k].packets += c.packets;
+                ret.slot[k].bytes   += c.bytes;
+            }
+        }
+
+        return ret;
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <flight.hpp>
+
+#include <stdexcept>
+
+
+namespace flight
+{
+    std::atomic<uint64_t> requests;
+
+    void request(int)
+    {
+        requests.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
+    recorder::recorder(size_t bytes, uint64_t window_nsec, std::string const &expr)
+    : segment_size(bytes / 2)
+    , window(window_nsec)
+    , active(0)
+    , seen(requests.load(std::memory_order_relaxed))
+    , match()
+    , has_match(!expr.empty())
+    , linktype(DLT_EN10MB)
+    , dumps(0)
+    , frozen(false)
+    {
+        if (segment_size < 65536)
+            throw std::runtime_error("flight recorder: size too small");
+
+        // allocated and touched here, on the node of the thread...
+        //
+
+        for(auto &s : seg) {
+            s.data.assign(segment_size, 0);
+            s.used = 0;
+            s.packets = 0;
+            s.first = 0;
+        }
+
+        if (has_match)
+        {
+            auto p = pcap_open_dead(DLT_EN10MB, 65535);
+            if (pcap_compile(p, &match, expr.c_str(), 1, PCAP_NETMASK_UNKNOWN) < 0) {
+                std::string err = pcap_geterr(p);
+                pcap_close(p);
+                throw std::runtime_error("flight recorder: pcap_compile: " + err);
+            }
+            pcap_close(p);
+        }
+    }
+
+
+    recorder::~recorder()
+    {
+        if (has_match)
+            pcap_freecode(&match);
+    }
+
+
+    size_t
+    recorder::dump(std::string const &filename)
+    {
+        auto p = pcap_open_dead(linktype, 65535);
+        auto d = pcap_dump_open(p, filename.c_str());
+        if (d == nullptr) {
+            std::string err = pcap_geterr(p);
+            pcap_close(p);
+            frozen.store(false, std::memory_order_release);
+            throw std::runtime_error("flight recorder: pcap_dump_open: " + err);
+        }
+
+        size_t n = 0;
+
+        for(auto i : { active ^ 1, active })
+        {
+            auto &s = seg[i];
+            for(size_t off = 0; off < s.used; n++)
+            {
+                header x;
+                memcpy(&x, &s.data[off], sizeof(x));
+
+                struct pcap_pkthdr h;
+                h.ts.tv_sec  = x.sec;
+                h.ts.tv_usec = x.usec;
+                h.caplen     = x.caplen;
+                h.len        = x.len;
+
+                pcap_dump(reinterpret_cast<u_char *>(d), &h, &s.data[off + sizeof(x)]);
+                off += sizeof(x) + x.caplen;
+            }
+
+            s.used = 0;
+            s.packets = 0;
+        }
+
+        pcap_dump_close(d);
+        pcap_close(p);
+
+        dumps++;
+        frozen.store(false, std::memory_order_release);
+        return n;
+    }
+}
@@ -31,9 +31,14 @@ namespace global
 {
     std::atomic_bool stop;
     std::mutex syncout;
+    std::mutex syncstats;
+
+    std::atomic<size_t> ready;
+    std::atomic_bool start;
 
     std::vector<std::unique_ptr<capthread>> thread_ctx;
     std::vector<std::thread> thread;
+    std::vector<size_t> cores;
 
     unsigned char default_packet[1514] =
     {
@@ -20,6 +20,8 @@
 #include <capthread.hpp>
 #include <global.hpp>
 #include <options.hpp>
+#include <tsc.hpp>
+#include <record.hpp>
 
 #include <iostream>
 #include <cstdlib>
@@ -48,6 +50,32 @@ extern "C" {
             {
                 that->atomic_stat.in_count.fetch_add(1, std::memory_order_relaxed);
                 that->atomic_stat.in_band.fetch_add(h->len, std::memory_order_relaxed);
+
+                if (unlikely(that->probe != nullptr))
+                    that->probe->account(payload, h->caplen);
+
+                if (unlikely(that->burst != nullptr))
+                    that->burst->account(h);
+
+                if (unlikely(that->flows != nullptr))
+                    that->flows->account(that->parsed, h);
+
+                if (unlikely(that->breakdown != nullptr))
+                    that->breakdown->account(that->parsed, h);
+
+                if (unlikely(that->sizes != nullptr))
+                    that->sizes->account(h);
+
+                if (unlikely(that->patterns != nullptr))
+                {
+                    if (that->parsed.payload)
+                        that->patterns->account(that->parsed.payload, that->parsed.payload_len);
+                    else
+                        that->patterns->account(payload, h->caplen);
+                }
+
+                if (unlikely(that->flight != nullptr))
+                    that->flight->record(h, payload);
             }
 
             if (that->out)
@@ -67,11 +95,89 @@ extern "C" {
                 pcap_dump(reinterpret_cast<u_char *>(that->dumper), h, payload);
         }
     }
+
+
+    const struct captop_packet *
+    captop_parsed(const u_char *user)
+    {
+        auto that = reinterpret_cast<const capthread *>(user);
+        return that->layers ? &that->parsed : nullptr;
+    }
+}
+
+
+//
+// dispatch trampolines: parse the packet once (Layer > 0) for the meters
+// and the handler, and time the handler on sampled packets...
+//
+
+template <int Layer>
+static inline void
+parse_packet(capthread *that, const struct pcap_pkthdr *h, const u_char *payload)
+{
+    if (Layer)
+        packet::parse<Layer ? Layer : packet::l2>(payload, h->caplen, that->parsed);
+}
+
+
+template <int Layer>
+static void
+captop_parse_handler(u_char *user, const struct pcap_pkthdr *h, const u_char *payload)
+{
+    auto that = reinterpret_cast<capthread *>(user);
+
+    parse_packet<Layer>(that, h, payload);
+    that->handler(user, h, payload);
+}
+
+
+template <int Layer>
+static void
+captop_timed_handler(u_char *user, const struct pcap_pkthdr *h, const u_char *payload)
+{
+    auto that = reinterpret_cast<capthread *>(user);
+    auto lat  = that->latency.get();
+
+    if (likely(--lat->countdown != 0)) {
+        parse_packet<Layer>(that, h, payload);
+        that->handler(user, h, payload);
+        return;
+    }
+
+    lat->countdown = lat->sample;
+
+    auto t0 = tsc::start();
+    parse_packet<Layer>(that, h, payload);
+    that->handler(user, h, payload);
+    auto t1 = tsc::stop();
+
+    lat->cycles.record(t1 - t0);
+}
+
+
+pcap_handler
+instrument_handler(options const &, capthread *that, pcap_handler handler)
+{
+    static const pcap_handler parse_handler[] =
+    {
+        nullptr, nullptr, captop_parse_handler<2>, captop_parse_handler<3>, captop_parse_handler<4>
+    };
+
+    static const pcap_handler timed_handler[] =
+    {
+        captop_timed_handler<0>, nullptr, captop_timed_handler<2>, captop_timed_handler<3>, captop_timed_handler<4>
+    };
+
+    if (!that->latency && !that->layers)
+        return handler;
+
+    that->handler = handler;
+    return that->latency ? timed_handler[that->layers] : parse_handler[that->layers];
 }
 
 
 pcap_handler
-get_packet_handler(options const &opt)
+get_packet_handler(options const &opt, capthread *that)
 {
     auto is_suffix = [] (std::string const & value, std::string const & ending)
     {
@@ -104,7 +210,7 @@ get_packet_handler(options const &opt)
 
     auto cmd = compiler + " -O2 " + opt.handler + " -o " + handler_so + " -fPIC -shared" + args;
 
-    std::cout << "captop: running " << cmd << std::endl;
+    messages(opt) << "captop: running " << cmd << std::endl;
 
     if (system(cmd.c_str()) != 0)
     {
@@ -119,6 +225,17 @@ get_packet_handler(options const &opt)
     if (!r)
         throw std::runtime_error(opt.handler + ": function 'captop_handler' not found!");
 
+    // layers asked for by the handler (CAPTOP_LAYERS)...
+    //
+
+    if (auto layers = reinterpret_cast<const int *>(dlsym(handle, "captop_layers")))
+    {
+        if (*layers < 0 || *layers > packet::l4)
+            throw std::runtime_error(opt.handler + ": captop_layers must be in 0..4");
+        if (*layers)
+            that->layers = std::max(that->layers, std::max<int>(*layers, packet::l2));
+    }
+
     return r;
 }
 
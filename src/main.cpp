@@ -23,10 +23,15 @@
 #include <string>
 #include <cstring>
 #include <stdexcept>
+#include <algorithm>
 
 #include <global.hpp>
 #include <options.hpp>
 #include <util.hpp>
+#include <topology.hpp>
+#include <matrix.hpp>
+#include <probe.hpp>
+#include <sweep.hpp>
 
 namespace
 {
@@ -47,16 +52,57 @@ void usage()
                  "  -t --timeout NUM             Specify the timeout in msec.\n"
                  "     --immediate               Enable immediate mode.\n"
                  "     --nonblock                Enable nonblock mode.\n"
+                 "     --busy-poll USEC          Poll the device queue in a spin loop (SO_BUSY_POLL),\n"
+                 "                               backing off to poll() when idle.\n"
                  "  -O --no-optimize             Do not run the packet-matching code optimizer.\n"
                  "     --next                    Use pcap_next instead of pcap_loop.\n"
+                 "     --no-prefilter            Run BPF on files even for simple expressions.\n"
+                 "     --count-only              Count in the kernel with an eBPF socket filter,\n"
+                 "                               no packet is copied (simple expressions only).\n"
+                 "\nInstrumentation:\n"
+                 "     --interval SEC            Stats interval in seconds, e.g. 0.01 (default 1).\n"
+                 "     --warmup SEC              Exclude the first SEC seconds from the stats (default 1).\n"
+                 "     --duration SEC            Stop after a measurement window of SEC seconds.\n"
+                 "     --stats-format FORMAT     Emit one record per interval: json (lines) or csv.\n"
+                 "     --stats-file FILE         Write the records to FILE instead of stdout.\n"
+                 "     --shm NAME                Publish live stats in shared memory (see captop-stat).\n"
+                 "     --series-file FILE        Dump the per-interval rates to FILE (.csv or binary).\n"
+                 "     --series-size NUM         Number of samples kept for the dump (default 86400).\n"
+                 "     --latency NUM             Measure handler latency every NUM packets (1 = all).\n"
+                 "     --top NUM                 Show the top NUM flows by packets and bytes.\n"
+                 "     --breakdown               Show traffic per ethertype, IP protocol and VLAN.\n"
+                 "     --sizes rfc|fine          Show the frame size distribution (RFC 2819 buckets\n"
+                 "                               or 64-byte steps).\n"
+                 "     --patterns FILE           Search the payloads for the patterns in FILE\n"
+                 "                               (one per line, \\xHH escapes).\n"
+                 "     --burst-slot USEC         Detect microbursts with USEC time slots (>= 100).\n"
+                 "     --burst-threshold PPS     Count slots above PPS as bursts.\n"
                  "\nRange Filters:\n"
                  "  -F --filter [RANGES]         Range filters: e.g. -F 1-100,1024,8000-8010\n"
                  "\nGenerator:\n"
                  "  -R --rand-ip                 Randomize IPs addresses.\n"
                  "  -g --genlen  VALUE           Specify the length of injected packets.\n"
+                 "     --probe                   Generate on -o and capture on -i: measure one-way\n"
+                 "                               latency, loss, duplicates and reordering per stream.\n"
+                 "     --sweep SIZES             Throughput sweep from -o to -i: highest rate with loss\n"
+                 "                               below --max-loss for each frame size (rfc: 64,128,256,\n"
+                 "                               512,1024,1280,1518, or a list).\n"
+                 "     --trial SEC               Duration of a sweep trial (default 10).\n"
+                 "     --trial-warmup SEC        Frames sent before each trial (default 2).\n"
+                 "     --max-loss PCT            Loss threshold of the sweep (default 0).\n"
+                 "     --max-rate PPS            Upper bound of the sweep (default: generator maximum).\n"
+                 "     --matrix SPEC             Run every combination of capture parameters, e.g.\n"
+                 "                               \"thread=1,2;buffer=1M,8M;snaplen=64,1514;timeout=1,10;\n"
+                 "                               immediate=0,1;fanout=hash,cpu\", and rank them.\n"
+                 "     --window SEC              Measured window of a matrix trial (default 10).\n"
                  "\nInterface:\n"
-                 "  -i --interface IFNAME        Listen on interface.\n"
+                 "  -i --interface IFNAME        Listen on interface. Repeat to capture from several\n"
+                 "                               interfaces, one thread group each: --thread, --cores,\n"
+                 "                               --fanout and --bpf after a further -i apply to it.\n"
+                 "     --bpf EXPR                BPF expression of the last further interface.\n"
                  "  -o --output IFNAME           Inject packets into interface.\n"
+                 "     --bridge                  Forward both directions between -i and -o through\n"
+                 "                               TPACKET rings (-B: ring size, default 8 MB).\n"
                  "\nHandler:\n"
                  "  -H --handler source.c        Dynamically load the pcap handler.\n"
                  "     --compiler PATH           Specify the compiler to use.\n"
@@ -64,12 +110,27 @@ void usage()
                  "\nThread:\n"
                  "     --thread INT              Launch multiple capture threads (one per core).\n"
                  "     --first-core INT          Specify the index of the first core.\n"
+                 "     --cores LIST              Run the threads on LIST, e.g. 2,4,6-10 (default:\n"
+                 "                               the cores of the NUMA node of the interface).\n"
+                 "     --rx-queues               Bind each thread to one RX queue of the interface\n"
+                 "                               and run it on the core servicing the queue IRQ.\n"
 #ifdef PCAP_VERSION_FANOUT
                  "     --fanout GROUP STRING     Enable fanout!\n"
 #endif
                  "\nFile:\n"
                  "  -r --read  FILE              Read packets from file.\n"
+                 "     --null                    Null device: replay the packets of -r (or the generator\n"
+                 "                               template, see -g, --rand-ip) from memory in a loop.\n"
                  "  -w --write FILE              Write packets to file.\n"
+                 "     --flight MB               Flight recorder: keep the most recent packets of each\n"
+                 "                               thread in MB megabytes of memory (at least half of\n"
+                 "                               it is available), dumped on SIGUSR1 or a trigger\n"
+                 "                               (default handler only, not with -H).\n"
+                 "     --flight-window SEC       Keep at least SEC seconds instead (within MB).\n"
+                 "     --flight-file PREFIX      Dumps to PREFIX-THREAD-NUM.pcap (default flight).\n"
+                 "     --flight-match EXPR       Dump when a packet matches the BPF expression.\n"
+                 "     --flight-pps PPS          Dump when the rate rises above PPS.\n"
+                 "     --flight-drop PPS         Dump when the drops rise above PPS.\n"
                  "\nMiscellaneous:\n"
                  "     --version                 Print the version strings and exit.\n"
                  "  -? --help                    Print this help.\n";
@@ -141,6 +202,17 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "--busy-poll") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("busy poll time missing");
+
+            opt.busy_poll = static_cast<size_t>(std::atoi(argv[i]));
+            if (opt.busy_poll == 0)
+                throw std::runtime_error("--busy-poll: time must be > 0 usec");
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "-t", "--timeout") ) {
 
             if (++i == argc)
@@ -150,12 +222,249 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "--interval") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("interval missing");
+
+            auto sec = std::atof(argv[i]);
+            if (sec < 0.000001)
+                throw std::runtime_error("invalid interval");
+
+            opt.interval = static_cast<size_t>(sec * 1000000 + 0.5);
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--warmup") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("warmup missing");
+
+            auto sec = std::atof(argv[i]);
+            if (sec < 0)
+                throw std::runtime_error("invalid warmup");
+
+            opt.warmup = static_cast<size_t>(sec * 1000000 + 0.5);
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--duration") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("duration missing");
+
+            auto sec = std::atof(argv[i]);
+            if (sec < 0.000001)
+                throw std::runtime_error("invalid duration");
+
+            opt.duration = static_cast<size_t>(sec * 1000000 + 0.5);
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--stats-format") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("stats format missing");
+
+            opt.stats.format = argv[i];
+            if (opt.stats.format != "json" && opt.stats.format != "csv")
+                throw std::runtime_error("--stats-format: json or csv");
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--stats-file") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("stats file missing");
+
+            opt.stats.file = argv[i];
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--shm") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("shared memory name missing");
+
+            opt.stats.shm = argv[i];
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--series-file") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("series file missing");
+
+            opt.series.file = argv[i];
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--series-size") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("series size missing");
+
+            opt.series.size = static_cast<size_t>(std::atoll(argv[i]));
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--latency") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("latency sampling period missing");
+
+            opt.latency = static_cast<size_t>(std::atoi(argv[i]));
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--top") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("number of flows missing");
+
+            opt.top = static_cast<size_t>(std::atoi(argv[i]));
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--breakdown") ) {
+            opt.breakdown = true;
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--sizes") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("size buckets missing");
+
+            opt.sizes = argv[i];
+            if (opt.sizes != "rfc" && opt.sizes != "fine")
+                throw std::runtime_error("size buckets must be rfc or fine");
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--patterns") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("pattern file missing");
+
+            opt.patterns = argv[i];
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--burst-slot") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("burst slot missing");
+
+            opt.burst.slot = static_cast<size_t>(std::atoi(argv[i]));
+            if (opt.burst.slot < 100)
+                throw std::runtime_error("burst slot must be >= 100 usec");
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--burst-threshold") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("burst threshold missing");
+
+            opt.burst.threshold = static_cast<size_t>(std::atoll(argv[i]));
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "-i", "--interface") ) {
 
             if (++i == argc)
                 throw std::runtime_error("interface missing");
 
-            opt.in.ifname = argv[i];
+            // a further interface opens its own thread group...
+            //
+
+            if (opt.in.ifname.empty())
+                opt.in.ifname = argv[i];
+            else
+                opt.interfaces.push_back(options::interface{argv[i], 1, {}, ""
+#ifdef PCAP_VERSION_FANOUT
+                                                            , 0, ""
+#endif
+                                                            });
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--sweep") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("frame sizes missing");
+
+            opt.sweep.sizes = argv[i];
+            sweep::sizes(opt.sweep.sizes);
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--trial") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("trial duration missing");
+
+            opt.sweep.trial = std::atof(argv[i]);
+            if (opt.sweep.trial < 0.1)
+                throw std::runtime_error("--trial: at least 0.1 sec");
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--trial-warmup") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("warm-up duration missing");
+
+            opt.sweep.warmup = std::atof(argv[i]);
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--max-loss") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("loss threshold missing");
+
+            opt.sweep.loss = std::atof(argv[i]);
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--max-rate") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("rate missing");
+
+            opt.sweep.rate = static_cast<size_t>(std::atoll(argv[i]));
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--matrix") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("matrix spec missing");
+
+            opt.matrix.spec = argv[i];
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--window") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("window missing");
+
+            opt.matrix.window = std::atof(argv[i]);
+            if (opt.matrix.window < 0.1)
+                throw std::runtime_error("--window: at least 0.1 sec");
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--null") ) {
+            opt.null_device = true;
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--bridge") ) {
+            opt.bridge = true;
             continue;
         }
 
@@ -186,6 +495,64 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "--flight") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("flight recorder size missing");
+
+            opt.flight.size = static_cast<size_t>(std::atoi(argv[i])) << 20;
+            if (opt.flight.size == 0)
+                throw std::runtime_error("invalid flight recorder size");
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--flight-window") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("flight window missing");
+
+            opt.flight.window = std::atof(argv[i]);
+            if (opt.flight.window <= 0)
+                throw std::runtime_error("invalid flight window");
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--flight-file") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("flight file missing");
+
+            opt.flight.file = argv[i];
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--flight-match") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("flight match expression missing");
+
+            opt.flight.match = argv[i];
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--flight-pps") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("flight pps missing");
+
+            opt.flight.pps = static_cast<size_t>(std::atoll(argv[i]));
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--flight-drop") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("flight drop missing");
+
+            opt.flight.drop = static_cast<size_t>(std::atoll(argv[i]));
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "--version") ) {
             std::cout << version << std::endl;
             _Exit(0);
@@ -196,11 +563,26 @@ try
             continue;
         }
 
+        if ( any_strcmp(argv[i], "--no-prefilter") ) {
+            opt.prefilter = false;
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--count-only") ) {
+            opt.count_only = true;
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "--next") ) {
             opt.next = true;
             continue;
         }
 
+        if ( any_strcmp(argv[i], "--probe") ) {
+            opt.probe = true;
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "-R", "--rand-ip") ) {
             opt.rand_ip = true;
             continue;
@@ -248,7 +630,25 @@ try
             if (++i == argc)
                 throw std::runtime_error("number of thread missing");
 
-            opt.numthread = static_cast<size_t>(std::atoi(argv[i]));
+            (opt.interfaces.empty() ? opt.numthread : opt.interfaces.back().numthread) = static_cast<size_t>(std::atoi(argv[i]));
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--cores") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("core list missing");
+
+            auto &cores = opt.interfaces.empty() ? opt.cores : opt.interfaces.back().cores;
+            cores = topology::parse_list(argv[i]);
+            for(auto c : cores)
+                if (c >= CPU_SETSIZE)
+                    throw std::runtime_error("core " + std::to_string(c) + " out of range");
+            continue;
+        }
+
+        if ( any_strcmp(argv[i], "--rx-queues") ) {
+            opt.rx_queues = true;
             continue;
         }
 
@@ -266,15 +666,27 @@ try
 
             if (++i == argc)
                 throw std::runtime_error("number of group missing");
-            opt.group = static_cast<size_t>(std::atoi(argv[i]));
+            (opt.interfaces.empty() ? opt.group : opt.interfaces.back().group) = static_cast<size_t>(std::atoi(argv[i]));
 
             if (++i == argc)
                 throw std::runtime_error("fanout algorithm missing");
 
-            opt.fanout = argv[i];
+            (opt.interfaces.empty() ? opt.fanout : opt.interfaces.back().fanout) = argv[i];
             continue;
         }
 #endif
+        if ( any_strcmp(argv[i], "--bpf") ) {
+
+            if (++i == argc)
+                throw std::runtime_error("BPF expression missing");
+
+            if (opt.interfaces.empty())
+                throw std::runtime_error("--bpf applies to a further -i (the expression of the first one is the argument)");
+
+            opt.interfaces.back().bpf = argv[i];
+            continue;
+        }
+
         if ( any_strcmp(argv[i], "-h", "-?", "--help") )
             usage();
 
@@ -284,6 +696,22 @@ try
         throw std::runtime_error(std::string(argv[i]) + " unknown option!");
     }
 
+    // every thread group has at least one thread...
+    //
+
+    if (!opt.interfaces.empty() && (opt.numthread == 0 ||
+        std::any_of(opt.interfaces.begin(), opt.interfaces.end(), [] (options::interface const &i) { return i.numthread == 0; })))
+        throw std::runtime_error("--thread: at least one thread per interface");
+
+    // probe streams are numbered after the generator threads (1..N)...
+    //
+
+    if (opt.probe && opt.numthread >= probe::max_streams)
+        throw std::runtime_error("--probe: at most " + std::to_string(probe::max_streams - 1) + " generator threads");
+
+    if (!opt.matrix.spec.empty())
+        return matrix::run(opt, i == argc ? "" : argv[i]);
+
     return pcap_top(opt, i == argc ? "" : argv[i]);
 }
 catch(std::exception &e)
@@ -0,0 +1,339 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <matrix.hpp>
+#include <capthread.hpp>
+#include <global.hpp>
+#include <util.hpp>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+
+extern int pcap_top(struct options const &, std::string const &);
+extern void set_stop(int);
+
+
+namespace matrix
+{
+    namespace
+    {
+        // 64K, 8M, 1G...
+        //
+
+        size_t to_size(std::string const &value)
+        {
+            char *end;
+            auto n = std::strtoull(value.c_str(), &end, 10);
+            switch(*end)
+            {
+            case 'k': case 'K': return n << 10;
+            case 'm': case 'M': return n << 20;
+            case 'g': case 'G': return n << 30;
+            case '\0': return n;
+            }
+            throw std::runtime_error("--matrix: bad size " + value);
+        }
+
+        // counters of the children, sent back through a pipe...
+        //
+
+        struct sample
+        {
+            uint64_t packets;
+            uint64_t bytes;
+            uint64_t recv;          // kernel
+            uint64_t drop;          // kernel
+            double   elapsed;       // sec
+        };
+
+        sample snapshot()
+        {
+            std::lock_guard<std::mutex> lock(global::syncstats);
+
+            sample s = { 0, 0, 0, 0, 0 };
+            for(auto &t : global::thread_ctx)
+            {
+                capthread::stat st = t->atomic_stat;
+                s.packets += st.in_count;
+                s.bytes   += st.in_band;
+
+                struct pcap_stat k;
+                if (t->pstat && pcap_stats(t->pstat, &k) == 0) {
+                    s.recv += k.ps_recv;
+                    s.drop += k.ps_drop;
+                }
+            }
+            return s;
+        }
+
+        // child: the usual capture, with a measuring thread that takes the
+        // counters once the threads are released (after the warm-up, for
+        // live captures) and again after the window or at the end of the
+        // trace...
+        //
+
+        void trial(options const &opt, std::string const &filter, int fd)
+        {
+            auto devnull = open("/dev/null", O_WRONLY);
+            if (devnull >= 0)
+                dup2(devnull, STDOUT_FILENO);
+
+            std::thread meter([&] {
+                while (!global::start.load(std::memory_order_acquire) && !global::stop.load(std::memory_order_relaxed))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+                // a trace is measured from its first packet: the counters
+                // are still zero at the release...
+                //
+
+                sample a = { 0, 0, 0, 0, 0 };
+
+                if (opt.in.filename.empty() || opt.null_device)
+                {
+                    auto warmup_end = std::chrono::steady_clock::now() + std::chrono::microseconds(opt.warmup);
+                    while (std::chrono::steady_clock::now() < warmup_end && !global::stop.load(std::memory_order_relaxed))
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+                    a = snapshot();
+                }
+
+                auto t0 = std::chrono::steady_clock::now();
+                auto end = t0 + std::chrono::duration<double>(opt.matrix.window);
+
+                while (std::chrono::steady_clock::now() < end && !global::stop.load(std::memory_order_relaxed))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+                auto b = snapshot();
+                b.packets -= a.packets;
+                b.bytes   -= a.bytes;
+                b.recv    -= a.recv;
+                b.drop    -= a.drop;
+                b.elapsed  = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+                if (write(fd, &b, sizeof(b)) != sizeof(b))
+                    _exit(1);
+
+                global::stop.store(true, std::memory_order_relaxed);
+            });
+
+            try
+            {
+                pcap_top(opt, filter);
+            }
+            catch(std::exception &e)
+            {
+                std::cerr << "matrix: " << e.what() << std::endl;
+                _exit(1);
+            }
+
+            meter.join();
+            _exit(0);
+        }
+    }
+
+
+    std::vector<axis>
+    parse(std::string const &spec)
+    {
+        std::vector<axis> ret;
+        std::istringstream in(spec);
+        std::string item;
+
+        while (std::getline(in, item, ';'))
+        {
+            auto eq = item.find('=');
+            if (eq == std::string::npos)
+                throw std::runtime_error("--matrix: " + item + ": NAME=V1,V2,... expected");
+
+            axis a { item.substr(0, eq), {} };
+            std::istringstream vs(item.substr(eq + 1));
+            std::string v;
+            while (std::getline(vs, v, ','))
+                a.values.push_back(v);
+
+            if (a.values.empty())
+                throw std::runtime_error("--matrix: " + a.name + ": no value");
+
+            options check = default_options;
+            apply(check, a.name, a.values.front());     // validates the name
+
+            ret.push_back(a);
+        }
+
+        if (ret.empty())
+            throw std::runtime_error("--matrix: empty spec");
+        return ret;
+    }
+
+
+    void
+    apply(options &opt, std::string const &name, std::string const &value)
+    {
+        if (name == "thread")
+            opt.numthread = static_cast<size_t>(std::atoi(value.c_str()));
+        else if (name == "buffer")
+            opt.buffer_size = to_size(value);
+        else if (name == "snaplen")
+            opt.snaplen = static_cast<size_t>(std::atoi(value.c_str()));
+        else if (name == "timeout")
+            opt.timeout = static_cast<size_t>(std::atoi(value.c_str()));
+        else if (name == "immediate")
+            opt.immediate = value != "0";
+#ifdef PCAP_VERSION_FANOUT
+        else if (name == "fanout")
+        {
+            opt.fanout = value;
+            if (opt.group == 0)
+                opt.group = getpid() & 0xffff;
+        }
+#endif
+        else
+            throw std::runtime_error("--matrix: " + name + ": unknown parameter");
+    }
+
+
+    int
+    run(options const &opt, std::string const &filter)
+    {
+        auto axes = parse(opt.matrix.spec);
+
+        if (signal(SIGINT, set_stop) == SIG_ERR)
+            throw std::runtime_error("signal SIGINT");
+
+        size_t total = 1;
+        for(auto &a : axes)
+            total *= a.values.size();
+
+        std::cout << "matrix: " << total << " trials of " << opt.matrix.window << " sec on "
+                  << (opt.in.ifname.empty() ? opt.in.filename : opt.in.ifname) << std::endl;
+
+        std::vector<result> results;
+
+        for(size_t n = 0; n < total && !global::stop.load(std::memory_order_relaxed); n++)
+        {
+            // n-th combination (the last axis varies fastest)...
+            //
+
+            auto topt = opt;
+            topt.matrix.spec.clear();
+
+            std::string label;
+            size_t k = n;
+
+            for(size_t i = axes.size(); i-- > 0; )
+            {
+                auto &v = axes[i].values[k % axes[i].values.size()];
+                k /= axes[i].values.size();
+                apply(topt, axes[i].name, v);
+                label = axes[i].name + "=" + v + (label.empty() ? "" : " " + label);
+            }
+
+            int fds[2];
+            if (pipe(fds) < 0)
+                throw std::runtime_error("pipe");
+
+            std::cout.flush();
+
+            auto pid = fork();
+            if (pid < 0)
+                throw std::runtime_error("fork");
+
+            if (pid == 0)
+            {
+                close(fds[0]);
+                trial(topt, filter, fds[1]);
+            }
+
+            close(fds[1]);
+
+            sample s;
+            auto ok = read(fds[0], &s, sizeof(s)) == sizeof(s);
+            close(fds[0]);
+
+            int status;
+            waitpid(pid, &status, 0);
+
+            result r { label, topt.numthread, ok, 0, 0, 0 };
+            if (ok && s.elapsed > 0)
+            {
+                r.pps  = s.packets / s.elapsed;
+                r.bps  = s.bytes * 8 / s.elapsed;
+                r.drop = s.recv ? 100.0 * s.drop / s.recv : 0;
+            }
+
+            std::cout << std::setw(4) << n + 1 << '/' << total << ' ' << label << ": ";
+            if (ok)
+                std::cout << highlight(pretty(static_cast<uint64_t>(r.pps))) << " pps, drop " << highlight(r.drop) << "%" << std::endl;
+            else
+                std::cout << "failed" << std::endl;
+
+            results.push_back(r);
+        }
+
+        // ranking: pps per core, then the lowest drop rate...
+        //
+
+        std::stable_sort(results.begin(), results.end(), [] (result const &a, result const &b) {
+            if (a.ok != b.ok)
+                return a.ok;
+            auto pa = a.pps / std::max<size_t>(1, a.threads), pb = b.pps / std::max<size_t>(1, b.threads);
+            if (pa != pb)
+                return pa > pb;
+            return a.drop < b.drop;
+        });
+
+        std::cout << "ranking (pps per core, drop rate):" << std::endl;
+        std::cout << std::setw(4) << "#" << std::setw(14) << "pps/core" << std::setw(12) << "pps"
+                  << std::setw(14) << "bit/s" << std::setw(10) << "drop %" << "  parameters" << std::endl;
+
+        for(size_t i = 0; i < results.size(); i++)
+        {
+            auto &r = results[i];
+
+            std::ostringstream ppc, pps, bps;
+            ppc << pretty(static_cast<uint64_t>(r.pps / std::max<size_t>(1, r.threads)));
+            pps << pretty(static_cast<uint64_t>(r.pps));
+            bps << pretty(static_cast<uint64_t>(r.bps));
+
+            std::cout << std::setw(4) << i + 1;
+            if (r.ok)
+                std::cout << std::setw(14) << ppc.str() << std::setw(12) << pps.str()
+                          << std::setw(14) << bps.str() << std::setw(10) << r.drop;
+            else
+                std::cout << std::setw(50) << "failed";
+            std::cout << "  " << r.label << std::endl;
+        }
+
+        return 0;
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <nulldev.hpp>
+#include <global.hpp>
+
+#include <netinet/ip.h>
+#include <sys/time.h>
+
+#include <stdexcept>
+#include <random>
+#include <cstring>
+
+
+namespace nulldev
+{
+    void
+    trace::push(struct pcap_pkthdr const &h, const u_char *pkt)
+    {
+        hdr.push_back(h);
+        offset.push_back(data.size());
+        data.insert(data.end(), pkt, pkt + h.caplen);
+    }
+
+
+    trace
+    load(std::string const &filename, std::string const &filter, bool optimize, size_t limit)
+    {
+        char errbuf[PCAP_ERRBUF_SIZE];
+
+        auto in = pcap_open_offline(filename.c_str(), errbuf);
+        if (in == nullptr)
+            throw std::runtime_error("pcap_open_offline:" + std::string(errbuf));
+
+        // the filter runs once, at load time...
+        //
+
+        bpf_program fcode;
+        if (!filter.empty() && pcap_compile(in, &fcode, filter.c_str(), optimize, PCAP_NETMASK_UNKNOWN) < 0) {
+            std::string err = pcap_geterr(in);
+            pcap_close(in);
+            throw std::runtime_error("pcap_compile: " + err);
+        }
+
+        trace t;
+        struct pcap_pkthdr *h;
+        const u_char *pkt;
+
+        while (pcap_next_ex(in, &h, &pkt) == 1 && t.data.size() + h->caplen <= limit)
+        {
+            if (filter.empty() || pcap_offline_filter(&fcode, h, pkt))
+                t.push(*h, pkt);
+        }
+
+        if (!filter.empty())
+            pcap_freecode(&fcode);
+        pcap_close(in);
+
+        if (t.size() == 0)
+            throw std::runtime_error(filename + ": no packet to replay");
+        return t;
+    }
+
+
+    trace
+    synthesize(size_t len, size_t n, bool rand_ip)
+    {
+        trace t;
+        std::mt19937 gen;
+
+        unsigned char packet[1514];
+        memcpy(packet, global::default_packet, sizeof(packet));
+
+        auto ip = reinterpret_cast<iphdr *>(packet + 14);
+
+        struct pcap_pkthdr h;
+        gettimeofday(&h.ts, nullptr);
+        h.caplen = h.len = static_cast<bpf_u_int32>(len);
+
+        for(size_t i = 0; i < (rand_ip ? n : 1); i++)
+        {
+            if (rand_ip)
+            {
+                ip->saddr = static_cast<uint32_t>(gen());
+                ip->daddr = static_cast<uint32_t>(gen());
+            }
+            t.push(h, packet);
+        }
+
+        return t;
+    }
+}
@@ -0,0 +1,306 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <patterns.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+
+namespace patterns
+{
+    std::vector<std::string>
+    load(std::string const &filename)
+    {
+        std::ifstream in(filename);
+        if (!in)
+            throw std::runtime_error("patterns: could not open " + filename);
+
+        auto hex = [&] (char c) -> int {
+            return c >= '0' && c <= '9' ? c - '0' :
+                   c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                   c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        };
+
+        std::vector<std::string> ret;
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::string pat;
+            for(size_t i = 0; i < line.size(); i++)
+            {
+                if (line[i] == '\\' && i + 1 < line.size() && line[i+1] == '\\') {
+                    pat += '\\';
+                    i++;
+                }
+                else if (line[i] == '\\' && i + 3 < line.size() && line[i+1] == 'x' && hex(line[i+2]) >= 0 && hex(line[i+3]) >= 0) {
+                    pat += static_cast<char>(hex(line[i+2]) << 4 | hex(line[i+3]));
+                    i += 3;
+                }
+                else
+                    pat += line[i];
+            }
+
+            ret.push_back(std::move(pat));
+        }
+
+        if (ret.empty())
+            throw std::runtime_error("patterns: no pattern in " + filename);
+
+        return ret;
+    }
+
+
+    std::string
+    printable(std::string const &pattern)
+    {
+        std::string ret;
+        for(unsigned char c : pattern)
+        {
+            if (c >= 0x20 && c < 0x7f && c != '\\')
+                ret += static_cast<char>(c);
+            else {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\x%02x", c);
+                ret += buf;
+            }
+        }
+        return ret;
+    }
+
+
+    const char *
+    isa()
+    {
+#if defined(__AVX2__)
+        return "avx2";
+#elif defined(__SSSE3__)
+        return "ssse3";
+#else
+        return "scalar";
+#endif
+    }
+
+
+    matcher::matcher(std::vector<std::string> const &p)
+    : pats(p)
+    {
+        memset(lo1, 0, sizeof(lo1));
+        memset(hi1, 0, sizeof(hi1));
+        memset(lo2, 0, sizeof(lo2));
+        memset(hi2, 0, sizeof(hi2));
+
+        for(size_t n = 0; n < pats.size(); n++)
+        {
+            auto &pat = pats[n];
+            if (pat.empty())
+                throw std::runtime_error("patterns: empty pattern");
+
+            auto b   = n % buckets;
+            auto bit = static_cast<uint8_t>(1 << b);
+
+            bucket[b].push_back(static_cast<uint32_t>(n));
+
+            unsigned char c0 = pat[0];
+            lo1[c0 & 0xf] |= bit;
+            hi1[c0 >> 4]  |= bit;
+
+            // one-byte patterns match any second byte...
+            //
+
+            if (pat.size() == 1) {
+                for(size_t i = 0; i < 16; i++) {
+                    lo2[i] |= bit;
+                    hi2[i] |= bit;
+                }
+            }
+            else {
+                unsigned char c1 = pat[1];
+                lo2[c1 & 0xf] |= bit;
+                hi2[c1 >> 4]  |= bit;
+            }
+        }
+    }
+
+
+    namespace
+    {
+        // check the patterns of the buckets flagged at pos...
+        //
+
+        template <typename Fun>
+        inline void verify(matcher const &m, const u_char *data, size_t len, size_t pos, unsigned flags, Fun &match)
+        {
+            while (flags)
+            {
+                auto b = __builtin_ctz(flags);
+                flags &= flags - 1;
+
+                for(auto n : m.bucket[b])
+                {
+                    auto &pat = m.pats[n];
+                    if (pat.size() <= len - pos && memcmp(data + pos, pat.data(), pat.size()) == 0)
+                        match(n);
+                }
+            }
+        }
+
+
+        template <typename Fun>
+        void scan(matcher const &m, const u_char *data, size_t len, Fun match)
+        {
+            size_t i = 0;
+
+#if defined(__AVX2__)
+            auto lo1 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(m.lo1)));
+            auto hi1 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(m.hi1)));
+            auto lo2 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(m.lo2)));
+            auto hi2 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(m.hi2)));
+            auto nib = _mm256_set1_epi8(0x0f);
+            auto zero = _mm256_setzero_si256();
+
+            alignas(32) uint8_t flags[32];
+
+            for(; i + 33 <= len; i += 32)
+            {
+                auto v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+                auto v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 1));
+
+                auto c0 = _mm256_and_si256(_mm256_shuffle_epi8(lo1, _mm256_and_si256(v0, nib)),
+                                           _mm256_shuffle_epi8(hi1, _mm256_and_si256(_mm256_srli_epi16(v0, 4), nib)));
+                auto c1 = _mm256_and_si256(_mm256_shuffle_epi8(lo2, _mm256_and_si256(v1, nib)),
+                                           _mm256_shuffle_epi8(hi2, _mm256_and_si256(_mm256_srli_epi16(v1, 4), nib)));
+                auto r  = _mm256_and_si256(c0, c1);
+
+                auto hit = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(r, zero)));
+                if (__builtin_expect(hit == 0, 1))
+                    continue;
+
+                _mm256_store_si256(reinterpret_cast<__m256i *>(flags), r);
+                while (hit)
+                {
+                    auto k = __builtin_ctz(hit);
+                    hit &= hit - 1;
+                    verify(m, data, len, i + k, flags[k], match);
+                }
+            }
+
+#elif defined(__SSSE3__)
+            auto lo1 = _mm_load_si128(reinterpret_cast<const __m128i *>(m.lo1));
+            auto hi1 = _mm_load_si128(reinterpret_cast<const __m128i *>(m.hi1));
+            auto lo2 = _mm_load_si128(reinterpret_cast<const __m128i *>(m.lo2));
+            auto hi2 = _mm_load_si128(reinterpret_cast<const __m128i *>(m.hi2));
+            auto nib = _mm_set1_epi8(0x0f);
+            auto zero = _mm_setzero_si128();
+
+            alignas(16) uint8_t flags[16];
+
+            for(; i + 17 <= len; i += 16)
+            {
+                auto v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                auto v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 1));
+
+                auto c0 = _mm_and_si128(_mm_shuffle_epi8(lo1, _mm_and_si128(v0, nib)),
+                                        _mm_shuffle_epi8(hi1, _mm_and_si128(_mm_srli_epi16(v0, 4), nib)));
+                auto c1 = _mm_and_si128(_mm_shuffle_epi8(lo2, _mm_and_si128(v1, nib)),
+                                        _mm_shuffle_epi8(hi2, _mm_and_si128(_mm_srli_epi16(v1, 4), nib)));
+                auto r  = _mm_and_si128(c0, c1);
+
+                auto hit = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(r, zero))) & 0xffff;
+                if (__builtin_expect(hit == 0, 1))
+                    continue;
+
+                _mm_store_si128(reinterpret_cast<__m128i *>(flags), r);
+                while (hit)
+                {
+                    auto k = __builtin_ctz(hit);
+                    hit &= hit - 1;
+                    verify(m, data, len, i + k, flags[k], match);
+                }
+            }
+#endif
+            // tail (or the whole buffer without SIMD); past the end the
+            // second byte matches anything, verify() checks the length...
+            //
+
+            for(; i < len; i++)
+            {
+                unsigned c0 = data[i];
+                unsigned f  = m.lo1[c0 & 0xf] & m.hi1[c0 >> 4];
+                if (__builtin_expect(f == 0, 1))
+                    continue;
+
+                if (i + 1 < len) {
+                    unsigned c1 = data[i + 1];
+                    f &= m.lo2[c1 & 0xf] & m.hi2[c1 >> 4];
+                }
+
+                if (f)
+                    verify(m, data, len, i, f, match);
+            }
+        }
+    }
+
+
+    meter::meter(std::vector<std::string> const &pats)
+    : m(pats)
+    , packets(0)
+    , bytes(0)
+    , hits(new std::atomic<uint64_t>[pats.size()])
+    {
+        for(size_t n = 0; n < pats.size(); n++)
+            hits[n].store(0, std::memory_order_relaxed);
+    }
+
+
+    void
+    meter::account(const u_char *data, size_t len)
+    {
+        scan(m, data, len, [this] (uint32_t n) {
+            hits[n].store(hits[n].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        });
+
+        packets.store(packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        bytes.store(bytes.load(std::memory_order_relaxed) + len, std::memory_order_relaxed);
+    }
+
+
+    void
+    meter::read(snapshot &s) const
+    {
+        s.packets += packets.load(std::memory_order_relaxed);
+        s.bytes   += bytes.load(std::memory_order_relaxed);
+
+        s.hits.resize(m.pats.size());
+        for(size_t n = 0; n < m.pats.size(); n++)
+            s.hits[n] += hits[n].load(std::memory_order_relaxed);
+    }
+}
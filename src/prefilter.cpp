@@ -0,0 +1,206 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <prefilter.hpp>
+
+#include <arpa/inet.h>
+
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+
+namespace prefilter
+{
+    namespace
+    {
+        bool parse_addr(std::string const &s, uint32_t &addr)
+        {
+            struct in_addr a;
+            if (std::count(s.begin(), s.end(), '.') != 3 || inet_pton(AF_INET, s.c_str(), &a) != 1)
+                return false;
+            addr = ntohl(a.s_addr);
+            return true;
+        }
+
+        bool parse_num(std::string const &s, uint32_t max, uint32_t &n)
+        {
+            if (s.empty() || s.size() > 5 || !std::all_of(s.begin(), s.end(), ::isdigit))
+                return false;
+            n = static_cast<uint32_t>(std::atoi(s.c_str()));
+            return n <= max;
+        }
+
+        // restrict the allowed protocols to the intersection...
+        //
+
+        bool restrict(program &prog, std::vector<uint32_t> const &p)
+        {
+            if (prog.protos.empty()) {
+                prog.protos = p;
+                return true;
+            }
+
+            std::vector<uint32_t> r;
+            for(auto x : prog.protos)
+                if (std::find(p.begin(), p.end(), x) != p.end())
+                    r.push_back(x);
+
+            prog.protos = r;
+            return !r.empty();
+        }
+
+        bool restrict_l3(program &prog, unsigned l3)
+        {
+            if (prog.l3 && prog.l3 != l3)
+                return false;
+            prog.l3 = l3;
+            return true;
+        }
+    }
+
+
+    bool
+    compile(std::string const &filter, program &prog)
+    {
+        std::istringstream in(filter);
+        std::vector<std::string> tok;
+        std::string t;
+
+        while (in >> t)
+            tok.push_back(t);
+
+        prog = program{};
+
+        dir d = either;
+        bool qualified = false;
+
+        for(size_t i = 0; i < tok.size(); i++)
+        {
+            auto &w = tok[i];
+
+            if (w == "and" || w == "&&") {
+                if (qualified)
+                    return false;
+                continue;
+            }
+
+            if (w == "src" || w == "dst") {
+                if (qualified)
+                    return false;
+                d = w == "src" ? source : destination;
+                qualified = true;
+                continue;
+            }
+
+            if (w == "host" || w == "net" || w == "port")
+            {
+                if (i + 1 == tok.size())
+                    return false;
+
+                auto &arg = tok[++i];
+
+                if (w == "port") {
+                    uint32_t n;
+                    if (!parse_num(arg, 65535, n))
+                        return false;
+                    prog.ports.push_back(port{d, n});
+                }
+                else {
+                    uint32_t addr, len = 32;
+                    auto slash = arg.find('/');
+                    if (w == "host" && slash != std::string::npos)
+                        return false;
+                    if (!parse_addr(arg.substr(0, slash), addr))
+                        return false;
+                    if (slash != std::string::npos && !parse_num(arg.substr(slash + 1), 32, len))
+                        return false;
+
+                    uint32_t mask = len ? ~0u << (32 - len) : 0;
+                    if (addr & ~mask)
+                        return false;           // let pcap_compile complain...
+                    prog.addrs.push_back(address{d, addr, mask});
+                }
+
+                d = either;
+                qualified = false;
+                continue;
+            }
+
+            if (qualified)
+                return false;
+
+            bool ok = w == "ip"   ? restrict_l3(prog, 4) :
+                      w == "ip6"  ? restrict_l3(prog, 6) :
+                      w == "tcp"  ? restrict(prog, {6}) :
+                      w == "udp"  ? restrict(prog, {17}) :
+                      w == "sctp" ? restrict(prog, {132}) :
+                      w == "icmp" ? restrict_l3(prog, 4) && restrict(prog, {1}) :
+                      false;
+            if (!ok)
+                return false;
+        }
+
+        if (qualified || tok.empty())
+            return false;
+
+        // host and net alone also match ARP/RARP: leave them to BPF...
+        //
+
+        if (!prog.addrs.empty() && !prog.l3 && prog.protos.empty() && prog.ports.empty())
+            return false;
+
+        return true;
+    }
+
+
+    std::string
+    to_string(program const &prog)
+    {
+        std::ostringstream out;
+        const char *dirs[] = { "", "src ", "dst " };
+        const char *sep = "";
+
+        if (prog.l3) {
+            out << (prog.l3 == 4 ? "ip" : "ip6");
+            sep = " and ";
+        }
+
+        for(auto p : prog.protos) {
+            out << sep << (p == 6 ? "tcp" : p == 17 ? "udp" : p == 132 ? "sctp" : "icmp");
+            sep = " and ";
+        }
+
+        for(auto &a : prog.addrs) {
+            struct in_addr ia;
+            ia.s_addr = htonl(a.net);
+            char buf[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &ia, buf, sizeof(buf));
+            out << sep << dirs[a.d] << "net " << buf << '/' << __builtin_popcount(a.mask);
+            sep = " and ";
+        }
+
+        for(auto &p : prog.ports) {
+            out << sep << dirs[p.d] << "port " << p.value;
+            sep = " and ";
+        }
+
+        return out.str();
+    }
+}
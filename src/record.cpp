@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <record.hpp>
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+
+record_writer::record_writer(FILE *out)
+: out_(out)
+{}
+
+
+record_writer::~record_writer()
+{
+    if (out_ && out_ != stdout)
+        fclose(out_);
+    else if (out_)
+        fflush(out_);
+}
+
+
+namespace
+{
+    double rate(unsigned long value, double sec)
+    {
+        return sec > 0 ? value / sec : 0;
+    }
+
+    //
+    // JSON lines: one object per record...
+    //
+
+    struct json_writer : record_writer
+    {
+        json_writer(FILE *out)
+        : record_writer(out)
+        {}
+
+        void counters(capthread::stat const &t, capthread::stat const &d, double sec)
+        {
+            fprintf(out_, "\"in_count\":%lu,\"in_band\":%lu,\"out_count\":%lu,\"out_band\":%lu,\"fail\":%lu,"
+                          "\"in_pps\":%.3f,\"in_bps\":%.3f,\"out_pps\":%.3f,\"out_bps\":%.3f,\"fail_ps\":%.3f",
+                    t.in_count, t.in_band, t.out_count, t.out_band, t.fail,
+                    rate(d.in_count, sec), rate(d.in_band * 8, sec),
+                    rate(d.out_count, sec), rate(d.out_band * 8, sec), rate(d.fail, sec));
+        }
+
+        void write(stats_record const &r) override
+        {
+            fprintf(out_, "{\"type\":\"%s\",\"timestamp\":%.6f,\"interval\":%.6f,\"threads\":[",
+                    r.type, r.timestamp, r.interval);
+
+            for(size_t i = 0; i < r.threads.size(); i++)
+            {
+                fprintf(out_, "%s{\"id\":%zu,", i ? "," : "", i);
+                counters(r.threads[i], r.delta[i], r.interval);
+                fputc('}', out_);
+            }
+
+            fputs("],\"total\":{", out_);
+            counters(sum(r.threads), sum(r.delta), r.interval);
+
+            fprintf(out_, "},\"kernel\":{\"recv\":%u,\"drop\":%u,\"ifdrop\":%u,\"drop_ps\":%.3f,\"ifdrop_ps\":%.3f}}\n",
+                    r.kernel.ps_recv, r.kernel.ps_drop, r.kernel.ps_ifdrop,
+                    rate(r.kernel_delta.ps_drop, r.interval), rate(r.kernel_delta.ps_ifdrop, r.interval));
+
+            fflush(out_);
+        }
+    };
+
+    //
+    // CSV: one row per thread plus a "total" row (carrying the kernel
+    // counters) for every record...
+    //
+
+    struct csv_writer : record_writer
+    {
+        csv_writer(FILE *out)
+        : record_writer(out)
+        {
+            fputs("type,timestamp,interval,thread,in_count,in_band,out_count,out_band,fail,"
+                  "in_pps,in_bps,out_pps,out_bps,fail_ps,recv,drop,ifdrop,drop_ps,ifdrop_ps\n", out_);
+        }
+
+        void row(stats_record const &r, const char *id, capthread::stat const &t, capthread::stat const &d)
+        {
+            fprintf(out_, "%s,%.6f,%.6f,%s,%lu,%lu,%lu,%lu,%lu,%.3f,%.3f,%.3f,%.3f,%.3f",
+                    r.type, r.timestamp, r.interval, id,
+                    t.in_count, t.in_band, t.out_count, t.out_band, t.fail,
+                    rate(d.in_count, r.interval), rate(d.in_band * 8, r.interval),
+                    rate(d.out_count, r.interval), rate(d.out_band * 8, r.interval), rate(d.fail, r.interval));
+        }
+
+        void write(stats_record const &r) override
+        {
+            char id[24];
+            for(size_t i = 0; i < r.threads.size(); i++)
+            {
+                snprintf(id, sizeof(id), "%zu", i);
+                row(r, id, r.threads[i], r.delta[i]);
+                fputs(",,,,,\n", out_);
+            }
+
+            row(r, "total", sum(r.threads), sum(r.delta));
+            fprintf(out_, ",%u,%u,%u,%.3f,%.3f\n",
+                    r.kernel.ps_recv, r.kernel.ps_drop, r.kernel.ps_ifdrop,
+                    rate(r.kernel_delta.ps_drop, r.interval), rate(r.kernel_delta.ps_ifdrop, r.interval));
+
+            fflush(out_);
+        }
+    };
+}
+
+
+std::unique_ptr<record_writer>
+record_writer::make(std::string const &format, std::string const &filename)
+{
+    FILE *out = stdout;
+
+    if (format != "json" && format != "csv")
+        throw std::runtime_error("stats format: " + format + " not supported (json|csv)");
+
+    if (!filename.empty()) {
+        out = fopen(filename.c_str(), "w");
+        if (!out)
+            throw std::runtime_error(filename + ": " + strerror(errno));
+    }
+
+    if (format == "json")
+        return std::unique_ptr<record_writer>(new json_writer(out));
+
+    return std::unique_ptr<record_writer>(new csv_writer(out));
+}
+
+
+std::ostream &
+messages(options const &opt)
+{
+    return !opt.stats.format.empty() && opt.stats.file.empty() ? std::cerr : std::cout;
+}
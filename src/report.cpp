@@ -0,0 +1,39 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#include <report.hpp>
+#include <util.hpp>
+
+
+void print_stats(std::ostream &out, tid const &id, capthread::stat const &t, capthread::stat const &t_, std::chrono::duration<double> delta)
+{
+        auto in_pps  = persecond(t.in_count  - t_.in_count, delta);
+        auto out_pps = persecond(t.out_count - t_.out_count, delta);
+        auto in_bps  = persecond((t.in_band  - t_.in_band) * 8, delta);
+        auto out_bps = persecond((t.out_band - t_.out_band) * 8, delta);
+        auto fail_ps = persecond(t.fail - t_.fail, delta);
+
+        out << id;
+        out << " packets: "  << highlight(t.in_count)      << '(' << highlight(in_pps) << " pps)";
+        out << " in-band: "  << highlight(pretty(in_bps))  << "bit/sec";
+        out << " injected: " << highlight(t.out_count)     << '(' << highlight(out_pps) << " pps)";
+        out << " fail: "     << highlight(t.fail)          << '(' << highlight(fail_ps) << "/sec)";
+        out << " out-band: " << highlight(pretty(out_bps)) << "bit/sec";
+}
@@ -0,0 +1,246 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <ring.hpp>
+
+#include <pcap/pcap.h>
+
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#ifndef PACKET_QDISC_BYPASS
+#define PACKET_QDISC_BYPASS     20
+#endif
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING  23
+#endif
+
+
+namespace ring
+{
+    namespace
+    {
+        std::runtime_error error(std::string const &what)
+        {
+            return std::runtime_error(what + ": " + strerror(errno));
+        }
+
+        // frames fit the MTU (plus Ethernet and two VLAN tags)...
+        //
+
+        size_t frame_size(int fd, std::string const &ifname)
+        {
+            struct ifreq ifr;
+            memset(&ifr, 0, sizeof(ifr));
+            strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+            if (ioctl(fd, SIOCGIFMTU, &ifr) < 0)
+                throw error("SIOCGIFMTU " + ifname);
+
+            size_t need = TPACKET2_HDRLEN + ifr.ifr_mtu + 14 + 8, size = 2048;
+            while (size < need)
+                size <<= 1;
+            return size;
+        }
+
+        // GRO merges the frames of a flow into skbs larger than the MTU...
+        //
+
+        bool gro(int fd, std::string const &ifname)
+        {
+            struct ethtool_value ev;
+            ev.cmd  = ETHTOOL_GGRO;
+            ev.data = 0;
+
+            struct ifreq ifr;
+            memset(&ifr, 0, sizeof(ifr));
+            strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+            ifr.ifr_data = reinterpret_cast<char *>(&ev);
+
+            return ioctl(fd, SIOCETHTOOL, &ifr) == 0 && ev.data != 0;
+        }
+
+        void attach(int fd, struct bpf_program const &prog)
+        {
+            struct sock_fprog fprog;
+            fprog.len    = static_cast<unsigned short>(prog.bf_len);
+            fprog.filter = reinterpret_cast<struct sock_filter *>(prog.bf_insns);
+
+            if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0)
+                throw error("SO_ATTACH_FILTER");
+        }
+    }
+
+
+    // protocol 0: nothing is received until bind, and never on the TX
+    // ring, which is not read...
+    //
+
+    socket::socket(std::string const &ifname, int ring, size_t bytes, struct bpf_program const *filter)
+    : fd(::socket(AF_PACKET, SOCK_RAW, 0))
+    , map(nullptr)
+    , map_size(0)
+    , frame_size(0)
+    , frames(0)
+    , head(0)
+    {
+        if (fd < 0)
+            throw error("AF_PACKET socket");
+
+        try
+        {
+            int v = TPACKET_V2;
+            if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v)) < 0)
+                throw error("PACKET_VERSION");
+
+            // blocks of 64 frames...
+            //
+
+            frame_size = ring::frame_size(fd, ifname);
+
+            struct tpacket_req req;
+            req.tp_frame_size = static_cast<unsigned>(frame_size);
+            req.tp_block_size = static_cast<unsigned>(frame_size * 64);
+            req.tp_block_nr   = static_cast<unsigned>(std::max<size_t>(1, bytes / req.tp_block_size));
+            req.tp_frame_nr   = req.tp_block_nr * 64;
+
+            if (setsockopt(fd, SOL_PACKET, ring, &req, sizeof(req)) < 0)
+                throw error(ring == PACKET_RX_RING ? "PACKET_RX_RING" : "PACKET_TX_RING");
+
+            frames   = req.tp_frame_nr;
+            map_size = static_cast<size_t>(req.tp_block_size) * req.tp_block_nr;
+
+            auto m = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, fd, 0);
+            if (m == MAP_FAILED)
+                m = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (m == MAP_FAILED)
+                throw error("mmap ring");
+
+            map = static_cast<uint8_t *>(m);
+
+            struct sockaddr_ll ll;
+            memset(&ll, 0, sizeof(ll));
+            ll.sll_family   = AF_PACKET;
+            ll.sll_protocol = ring == PACKET_RX_RING ? htons(ETH_P_ALL) : 0;
+            ll.sll_ifindex  = static_cast<int>(if_nametoindex(ifname.c_str()));
+
+            if (ll.sll_ifindex == 0)
+                throw error(ifname);
+
+            if (filter)
+                attach(fd, *filter);
+
+            // the other direction transmits on the RX interface: not ours...
+            //
+
+            int one = 1;
+            if (ring == PACKET_RX_RING)
+                setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+
+            if (bind(fd, reinterpret_cast<struct sockaddr *>(&ll), sizeof(ll)) < 0)
+                throw error("bind " + ifname);
+        }
+        catch(...)
+        {
+            if (map)
+                munmap(map, map_size);
+            close(fd);
+            throw;
+        }
+    }
+
+
+    socket::~socket()
+    {
+        munmap(map, map_size);
+        close(fd);
+    }
+
+
+    rx::rx(std::string const &ifname, size_t bytes, struct bpf_program const *filter)
+    : socket(ifname, PACKET_RX_RING, bytes, filter)
+    , gro(ring::gro(fd, ifname))
+    {
+        struct packet_mreq mr;
+        memset(&mr, 0, sizeof(mr));
+        mr.mr_ifindex = static_cast<int>(if_nametoindex(ifname.c_str()));
+        mr.mr_type    = PACKET_MR_PROMISC;
+        if (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr)) < 0)
+            throw error("PACKET_ADD_MEMBERSHIP " + ifname);
+    }
+
+
+    bool
+    rx::wait(int timeout) const
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        return poll(&pfd, 1, timeout) > 0;
+    }
+
+
+    uint64_t
+    rx::drops()
+    {
+        struct tpacket_stats st;
+        socklen_t len = sizeof(st);
+        if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) < 0)
+            return 0;
+        return st.tp_drops;
+    }
+
+
+    tx::tx(std::string const &ifname, size_t bytes)
+    : socket(ifname, PACKET_TX_RING, bytes)
+    , offset(TPACKET_ALIGN(sizeof(struct tpacket2_hdr)))
+    , pending(0)
+    {
+        // straight to the driver, the packets are already on the wire
+        // of the other side...
+        //
+
+        int one = 1;
+        setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+    }
+
+
+    void
+    tx::flush()
+    {
+        if (!pending)
+            return;
+
+        if (send(fd, nullptr, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS)
+            throw error("send TX ring");
+
+        pending = 0;
+    }
+}
@@ -0,0 +1,284 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <rxqueue.hpp>
+#include <topology.hpp>
+
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <linux/if_packet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+
+
+namespace rxqueue
+{
+    size_t
+    count(std::string const &ifname)
+    {
+        auto dir = opendir(("/sys/class/net/" + ifname + "/queues").c_str());
+        if (!dir)
+            return 0;
+
+        size_t n = 0;
+        while (auto e = readdir(dir))
+            if (strncmp(e->d_name, "rx-", 3) == 0)
+                n++;
+
+        closedir(dir);
+        return n;
+    }
+
+
+    namespace
+    {
+        // the queue number in an IRQ name, e.g. eth0-TxRx-3, eth0-rx-3,
+        // mlx5_comp3@pci:...; -1 if none...
+        //
+
+        int queue_of(std::string const &name, std::string const &ifname)
+        {
+            std::string n = name;
+            auto at = n.find('@');
+            if (at != std::string::npos)
+                n.resize(at);
+
+            bool mine = n.find(ifname) != std::string::npos || n.find("comp") != std::string::npos;
+            if (!mine || n.find("tx-") != std::string::npos)
+                return -1;
+
+            auto end = n.size();
+            while (end > 0 && !isdigit(n[end-1]))
+                end--;
+            auto begin = end;
+            while (begin > 0 && isdigit(n[begin-1]))
+                begin--;
+
+            if (begin == end)
+                return -1;
+
+            return std::atoi(n.substr(begin, end - begin).c_str());
+        }
+    }
+
+
+    std::vector<int>
+    irqs(std::string const &ifname, size_t nqueues)
+    {
+        std::vector<int> ret(nqueues, -1);
+
+        // IRQs of the device (MSI-X vectors), if listed...
+        //
+
+        std::vector<int> dev;
+        if (auto dir = opendir(("/sys/class/net/" + ifname + "/device/msi_irqs").c_str()))
+        {
+            while (auto e = readdir(dir))
+                if (isdigit(e->d_name[0]))
+                    dev.push_back(std::atoi(e->d_name));
+            closedir(dir);
+        }
+
+        std::ifstream in("/proc/interrupts");
+        std::string line;
+
+        std::getline(in, line);         // CPU header
+
+        while (std::getline(in, line))
+        {
+            std::istringstream ls(line);
+            std::string irq, tok, name;
+
+            ls >> irq;
+            if (irq.empty() || !isdigit(irq[0]))
+                continue;
+
+            while (ls >> tok)
+                name = tok;             // the name is the last column
+
+            auto n = std::atoi(irq.c_str());
+            if (!dev.empty() && std::find(dev.begin(), dev.end(), n) == dev.end())
+                continue;
+            if (dev.empty() && name.find(ifname) == std::string::npos)
+                continue;
+
+            auto q = queue_of(name, ifname);
+            if (q >= 0 && static_cast<size_t>(q) < nqueues && ret[q] == -1)
+                ret[q] = n;
+        }
+
+        return ret;
+    }
+
+
+    int
+    irq_core(int irq)
+    {
+        if (irq < 0)
+            return -1;
+
+        // the effective affinity if the kernel exposes it...
+        //
+
+        for(auto f : { "/effective_affinity_list", "/smp_affinity_list" })
+        {
+            std::ifstream in("/proc/irq/" + std::to_string(irq) + f);
+            std::string s;
+            if (std::getline(in, s) && !s.empty()) {
+                auto cpus = topology::parse_list(s);
+                if (!cpus.empty())
+                    return static_cast<int>(cpus.front());
+            }
+        }
+
+        return -1;
+    }
+
+
+    void
+    join_fanout(int fd, int group)
+    {
+        int arg = (group & 0xffff) | (PACKET_FANOUT_QM << 16);
+        if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0)
+            throw std::runtime_error(std::string("PACKET_FANOUT: ") + strerror(errno));
+    }
+
+
+    namespace
+    {
+        int ethtool(int fd, std::string const &ifname, void *data)
+        {
+            struct ifreq ifr;
+            memset(&ifr, 0, sizeof(ifr));
+            strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+            ifr.ifr_data = reinterpret_cast<char *>(data);
+            return ioctl(fd, SIOCETHTOOL, &ifr);
+        }
+
+        // rx_queue_0_packets (ixgbe, virtio), rx-0.packets (i40e, ice),
+        // rx0_packets (mlx5), queue_0_rx_cnt (ena)...
+        //
+
+        int stat_queue(std::string const &name)
+        {
+            if (name.find("rx") == std::string::npos)
+                return -1;
+            if (name.find("packets") == std::string::npos && name.find("_cnt") == std::string::npos)
+                return -1;
+            if (name.find("bytes") != std::string::npos || name.find("drop") != std::string::npos ||
+                name.find("err") != std::string::npos || name.find("xdp") != std::string::npos)
+                return -1;
+
+            auto d = std::find_if(name.begin(), name.end(), ::isdigit);
+            if (d == name.end())
+                return -1;
+
+            return std::atoi(&*d);
+        }
+    }
+
+
+    counters::counters(std::string const &name)
+    : ifname(name)
+    , fd(socket(AF_INET, SOCK_DGRAM, 0))
+    , nstats(0)
+    {
+        if (fd < 0)
+            return;
+
+        // number of statistics and their names...
+        //
+
+        std::unique_ptr<char[]> buf(new char[sizeof(struct ethtool_sset_info) + sizeof(uint32_t)]);
+        auto info = reinterpret_cast<struct ethtool_sset_info *>(buf.get());
+        memset(info, 0, sizeof(*info) + sizeof(uint32_t));
+        info->cmd       = ETHTOOL_GSSET_INFO;
+        info->sset_mask = 1ull << ETH_SS_STATS;
+
+        if (ethtool(fd, ifname, info) < 0 || !(info->sset_mask & (1ull << ETH_SS_STATS)))
+            return;
+
+        nstats = info->data[0];
+
+        std::unique_ptr<char[]> sbuf(new char[sizeof(struct ethtool_gstrings) + nstats * ETH_GSTRING_LEN]);
+        auto strings = reinterpret_cast<struct ethtool_gstrings *>(sbuf.get());
+        strings->cmd        = ETHTOOL_GSTRINGS;
+        strings->string_set = ETH_SS_STATS;
+        strings->len        = nstats;
+
+        if (ethtool(fd, ifname, strings) < 0) {
+            nstats = 0;
+            return;
+        }
+
+        for(uint32_t i = 0; i < nstats; i++)
+        {
+            std::string s(reinterpret_cast<char *>(strings->data) + i * ETH_GSTRING_LEN,
+                          strnlen(reinterpret_cast<char *>(strings->data) + i * ETH_GSTRING_LEN, ETH_GSTRING_LEN));
+
+            auto q = stat_queue(s);
+            if (q < 0 || q > 4096)
+                continue;
+            if (static_cast<size_t>(q) >= index.size())
+                index.resize(q + 1, -1);
+            if (index[q] == -1)
+                index[q] = static_cast<int>(i);
+        }
+    }
+
+
+    counters::~counters()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+
+    std::vector<uint64_t>
+    counters::read() const
+    {
+        std::vector<uint64_t> ret;
+        if (index.empty())
+            return ret;
+
+        std::unique_ptr<char[]> buf(new char[sizeof(struct ethtool_stats) + nstats * sizeof(uint64_t)]);
+        auto stats = reinterpret_cast<struct ethtool_stats *>(buf.get());
+        stats->cmd     = ETHTOOL_GSTATS;
+        stats->n_stats = nstats;
+
+        if (ethtool(fd, ifname, stats) < 0)
+            return ret;
+
+        for(auto i : index)
+            ret.push_back(i >= 0 ? stats->data[i] : 0);
+        return ret;
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <series.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+
+namespace series
+{
+    void
+    recorder::dump(std::string const &filename) const
+    {
+        auto csv = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+
+        FILE *out = fopen(filename.c_str(), csv ? "w" : "wb");
+        if (!out)
+            throw std::runtime_error(filename + ": " + strerror(errno));
+
+        auto first = ring.size() < capacity_ ? 0 : next_;
+
+        if (csv)
+        {
+            fputs("time,thread,pps,bps,drop_ps\n", out);
+        }
+        else
+        {
+            // header: magic, version, record size, number of records...
+            //
+            uint32_t hdr[4] = { magic, version, sizeof(sample), static_cast<uint32_t>(ring.size()) };
+            fwrite(hdr, sizeof(hdr), 1, out);
+        }
+
+        for(size_t i = 0; i < ring.size(); i++)
+        {
+            auto &s = ring[(first + i) % ring.size()];
+            if (!csv) {
+                fwrite(&s, sizeof(s), 1, out);
+                continue;
+            }
+
+            if (s.thread == total)
+                fprintf(out, "%.6f,total,%.3f,%.3f,%.3f\n", s.time / 1e9, s.pps, s.bps, s.drop);
+            else
+                fprintf(out, "%.6f,%u,%.3f,%.3f,%.3f\n", s.time / 1e9, s.thread, s.pps, s.bps, s.drop);
+        }
+
+        if (fclose(out) != 0)
+            throw std::runtime_error(filename + ": " + strerror(errno));
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <shmstats.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <new>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+
+namespace shm
+{
+    publisher::publisher(std::string name, size_t nthreads)
+    : name_(name[0] == '/' ? name : '/' + name)
+    , size_(segment_size(nthreads))
+    , hdr_(nullptr)
+    {
+        int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd == -1)
+            throw std::runtime_error("shm_open " + name_ + ": " + strerror(errno));
+
+        if (ftruncate(fd, size_) == -1) {
+            ::close(fd);
+            throw std::runtime_error("ftruncate " + name_ + ": " + strerror(errno));
+        }
+
+        auto addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("mmap " + name_ + ": " + strerror(errno));
+
+        hdr_ = new (addr) header;
+
+        hdr_->header_size = sizeof(header);
+        hdr_->record_size = sizeof(thread_record);
+        hdr_->nthreads    = nthreads;
+        hdr_->pid         = getpid();
+        hdr_->seq.store(0, std::memory_order_relaxed);
+
+        for(size_t n = 0; n < nthreads; n++)
+        {
+            auto r = new (record(hdr_, n)) thread_record;
+            r->seq.store(0, std::memory_order_relaxed);
+            r->id = n;
+        }
+
+        // the magic is written last, once the layout is in place...
+        //
+
+        hdr_->version = version;
+        std::atomic_thread_fence(std::memory_order_release);
+        hdr_->magic = magic;
+    }
+
+
+    publisher::~publisher()
+    {
+        munmap(hdr_, size_);
+        shm_unlink(name_.c_str());
+    }
+}
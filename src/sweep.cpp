@@ -0,0 +1,396 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <sweep.hpp>
+#include <global.hpp>
+#include <topology.hpp>
+#include <probe.hpp>
+#include <util.hpp>
+
+#include <pcap/pcap.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+
+namespace sweep
+{
+    namespace
+    {
+        // trial marker, right after the eth/ip/icmp headers (fits 64-byte
+        // frames, unlike the probe payload); trial 0 marks warm-up frames...
+        //
+
+        const uint32_t magic  = 0x5eeb2544;
+        const size_t   offset = 14 + 20 + 8;
+
+        struct marker
+        {
+            uint32_t magic;
+            uint32_t trial;
+        } __attribute__((packed));
+
+        // binary search: stop when the interval is below 0.5% of the
+        // upper bound, or after 16 trials...
+        //
+
+        const double resolution = 0.005;
+        const size_t max_trials = 16;
+
+        // frames still in flight after the generator stops...
+        //
+
+        const auto drain = std::chrono::milliseconds(500);
+
+
+        // internet checksum (RFC 1071) of len bytes...
+        //
+
+        uint16_t checksum(const unsigned char *p, size_t len)
+        {
+            uint32_t sum = 0;
+            for(size_t i = 0; i + 1 < len; i += 2)
+                sum += static_cast<uint32_t>(p[i] << 8 | p[i+1]);
+            if (len & 1)
+                sum += static_cast<uint32_t>(p[len-1] << 8);
+            while (sum >> 16)
+                sum = (sum & 0xffff) + (sum >> 16);
+            return static_cast<uint16_t>(~sum);
+        }
+
+
+        struct receiver
+        {
+            receiver(options const &opt, std::string const &filter)
+            : in(nullptr), trial(0), count(0), done(false)
+            {
+                char errbuf[PCAP_ERRBUF_SIZE];
+
+                in = pcap_create(opt.in.ifname.c_str(), errbuf);
+                if (in == nullptr)
+                    throw std::runtime_error(std::string(errbuf));
+
+                if (opt.buffer_size)
+                    pcap_set_buffer_size(in, opt.buffer_size);
+
+                pcap_set_snaplen(in, static_cast<int>(offset + sizeof(marker)));
+                pcap_set_promisc(in, 1);
+                pcap_set_immediate_mode(in, 1);
+                pcap_set_timeout(in, 10);
+
+                auto fail = [&] (std::string const &what) {
+                    std::string err = what + pcap_geterr(in);
+                    pcap_close(in);
+                    throw std::runtime_error(err);
+                };
+
+                // warnings (> 0) do not prevent the capture...
+                //
+
+                if (pcap_activate(in) < 0)
+                    fail("pcap_activate: ");
+
+                if (!filter.empty())
+                {
+                    bpf_program fcode;
+                    if (pcap_compile(in, &fcode, filter.c_str(), opt.oflag, PCAP_NETMASK_UNKNOWN) < 0)
+                        fail("BPF: ");
+                    if (pcap_setfilter(in, &fcode) < 0) {
+                        pcap_freecode(&fcode);
+                        fail("BPF: ");
+                    }
+                    pcap_freecode(&fcode);
+                }
+            }
+
+            ~receiver()
+            {
+                pcap_close(in);
+            }
+
+            static void handler(u_char *user, const struct pcap_pkthdr *h, const u_char *bytes)
+            {
+                auto that = reinterpret_cast<receiver *>(user);
+                marker m;
+
+                if (h->caplen < offset + sizeof(m))
+                    return;
+
+                memcpy(&m, bytes + offset, sizeof(m));
+                if (m.magic == magic && m.trial != 0 && m.trial == that->trial.load(std::memory_order_relaxed))
+                    that->count.store(that->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+
+            void operator()()
+            {
+                while (!done.load(std::memory_order_relaxed) && !global::stop.load(std::memory_order_relaxed))
+                    if (pcap_dispatch(in, -1, handler, reinterpret_cast<u_char *>(this)) < 0)
+                        break;
+            }
+
+            pcap_t *in;
+            std::atomic<uint32_t> trial;
+            std::atomic<uint64_t> count;
+            std::atomic_bool done;
+        };
+
+
+        struct generator
+        {
+            generator(options const &opt)
+            : out(nullptr), packet()
+            {
+                char errbuf[PCAP_ERRBUF_SIZE];
+
+                out = pcap_open_live(opt.out.ifname.c_str(), 1514, 1, static_cast<int>(opt.timeout), errbuf);
+                if (out == nullptr)
+                    throw std::runtime_error("pcap_open_live: " + std::string(errbuf));
+
+                memcpy(packet, global::default_packet, sizeof(packet));
+            }
+
+            ~generator()
+            {
+                pcap_close(out);
+            }
+
+            // frames of len bytes at pps (0: as fast as possible) for nsec,
+            // returns the frames sent and the time taken...
+            //
+
+            std::pair<uint64_t, uint64_t>
+            send(size_t len, double pps, uint64_t nsec, uint32_t trial)
+            {
+                marker m = { magic, trial };
+                memcpy(packet + offset, &m, sizeof(m));
+
+                // IP total length of this frame size, then the IP and ICMP
+                // checksums (the marker is in the ICMP payload)...
+                //
+
+                auto ip   = packet + 14;
+                auto icmp = packet + 14 + 20;
+                auto tot  = static_cast<uint16_t>(len - 14);
+
+                ip[2] = static_cast<unsigned char>(tot >> 8);
+                ip[3] = static_cast<unsigned char>(tot);
+                ip[10] = ip[11] = 0;
+                auto ipsum = checksum(ip, 20);
+                ip[10] = static_cast<unsigned char>(ipsum >> 8);
+                ip[11] = static_cast<unsigned char>(ipsum);
+
+                icmp[2] = icmp[3] = 0;
+                auto icmpsum = checksum(icmp, len - 14 - 20);
+                icmp[2] = static_cast<unsigned char>(icmpsum >> 8);
+                icmp[3] = static_cast<unsigned char>(icmpsum);
+
+                auto gap   = pps > 0 ? 1e9 / pps : 0;
+                auto start = probe::now();
+                auto now   = start;
+                double next = 0;
+                uint64_t sent = 0;
+
+                while (now - start < nsec && !global::stop.load(std::memory_order_relaxed))
+                {
+                    if (gap)
+                    {
+                        while (static_cast<double>(now - start) < next)
+                            now = probe::now();
+                        next += gap;
+                    }
+
+                    if (pcap_inject(out, packet, len) >= 0)
+                        sent++;
+
+                    now = probe::now();
+                }
+
+                return { sent, now - start };
+            }
+
+            pcap_t *out;
+            unsigned char packet[1514];
+        };
+
+
+        uint64_t to_nsec(double sec)
+        {
+            return static_cast<uint64_t>(sec * 1e9);
+        }
+    }
+
+
+    std::vector<size_t>
+    sizes(std::string const &list)
+    {
+        if (list == "rfc")
+            return { 64, 128, 256, 512, 1024, 1280, 1518 };
+
+        std::vector<size_t> ret;
+        std::istringstream in(list);
+        std::string tok;
+
+        while (std::getline(in, tok, ','))
+        {
+            auto s = static_cast<size_t>(std::atoi(tok.c_str()));
+            if (s < 64 || s > 1518)
+                throw std::runtime_error("--sweep: frame size " + tok + " out of range (64-1518)");
+            ret.push_back(s);
+        }
+
+        if (ret.empty())
+            throw std::runtime_error("--sweep: no frame size");
+        return ret;
+    }
+
+
+    std::vector<result>
+    run(options const &opt, std::string const &filter, std::vector<size_t> const &cores)
+    {
+        if (opt.in.ifname.empty() || opt.out.ifname.empty())
+            throw std::runtime_error("sweep requires both input and output interfaces");
+
+        auto frames = sizes(opt.sweep.sizes);
+
+        // everything that can fail is opened before the receiver thread
+        // starts...
+        //
+
+        topology::local_scope local(cores[1]);
+        generator tx(opt);
+
+        std::unique_ptr<receiver> rx;
+        std::thread rx_thread;
+
+        {
+            topology::local_scope local(cores[0]);
+            rx.reset(new receiver(opt, filter));
+            rx_thread = std::thread(std::ref(*rx));
+        }
+
+        std::cout << "sweep " << opt.out.ifname << " -> " << opt.in.ifname << ": trial " << opt.sweep.trial
+                  << " sec, warm-up " << opt.sweep.warmup << " sec, loss <= " << opt.sweep.loss << "%" << std::endl;
+
+        uint32_t id = 0;
+        std::vector<result> results;
+
+        for(auto frame : frames)
+        {
+            auto len = frame - 4;           // FCS added by the NIC
+            result best = { frame, 0, 0, 0 };
+
+            // one trial: warm-up frames (not counted), then the measured
+            // ones; returns the loss (percent) and the rate achieved...
+            //
+
+            auto trial = [&] (double pps) {
+                if (opt.sweep.warmup > 0)
+                    tx.send(len, pps, to_nsec(opt.sweep.warmup), 0);
+
+                rx->count.store(0, std::memory_order_relaxed);
+                rx->trial.store(++id, std::memory_order_relaxed);
+
+                auto s = tx.send(len, pps, to_nsec(opt.sweep.trial), id);
+                std::this_thread::sleep_for(drain);
+
+                auto recv = rx->count.load(std::memory_order_relaxed);
+                auto loss = s.first ? 100.0 * (s.first - std::min(recv, s.first)) / s.first : 100.0;
+                auto rate = s.second ? 1e9 * s.first / s.second : 0.0;
+
+                best.trials++;
+                std::cout << std::setw(6) << frame << " bytes: offered " << highlight(pretty(static_cast<uint64_t>(rate)))
+                          << " pps, received " << highlight(recv) << '/' << highlight(s.first)
+                          << ", loss " << highlight(loss) << "%" << std::endl;
+
+                return std::make_pair(loss, rate);
+            };
+
+            // upper bound: --max-rate, or what the generator can do...
+            //
+
+            auto top = trial(static_cast<double>(opt.sweep.rate));
+            auto hi  = top.second;
+
+            if (top.first <= opt.sweep.loss)
+            {
+                best.pps  = top.second;
+                best.loss = top.first;
+            }
+            else
+            {
+                double lo = 0;
+                while (hi - lo > resolution * top.second && best.trials < max_trials &&
+                       !global::stop.load(std::memory_order_relaxed))
+                {
+                    auto mid = (lo + hi) / 2;
+                    auto r = trial(mid);
+                    if (r.first <= opt.sweep.loss) {
+                        lo = mid;
+                        best.pps  = r.second;
+                        best.loss = r.first;
+                    }
+                    else
+                        hi = mid;
+                }
+            }
+
+            results.push_back(best);
+
+            if (global::stop.load(std::memory_order_relaxed))
+                break;
+        }
+
+        rx->done.store(true, std::memory_order_relaxed);
+        pcap_breakloop(rx->in);
+        rx_thread.join();
+
+        return results;
+    }
+
+
+    void
+    print(std::vector<result> const &results)
+    {
+        std::cout << "throughput (loss threshold reached by binary search):" << std::endl;
+        std::cout << std::setw(6) << "frame" << std::setw(14) << "rate (pps)" << std::setw(16) << "line (bit/s)"
+                  << std::setw(10) << "loss %" << std::setw(8) << "trials" << std::endl;
+
+        for(auto &r : results)
+        {
+            // on the wire: preamble, SFD and inter-frame gap add 20 bytes...
+            auto bps = r.pps * (r.frame + 20) * 8;
+
+            std::ostringstream pps, line;
+            pps  << pretty(static_cast<uint64_t>(r.pps));
+            line << pretty(static_cast<uint64_t>(bps));
+
+            std::cout << std::setw(6) << r.frame << std::setw(14) << pps.str() << std::setw(16) << line.str()
+                      << std::setw(10) << r.loss << std::setw(8) << r.trials << std::endl;
+        }
+    }
+}
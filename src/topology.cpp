@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2014 Nicola Bonelli <nicola@pfq.io>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <topology.hpp>
+
+#include <pthread.h>
+#include <dirent.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace topology
+{
+    namespace
+    {
+        std::string read_line(std::string const &path)
+        {
+            std::ifstream in(path);
+            std::string s;
+            std::getline(in, s);
+            return s;
+        }
+    }
+
+
+    std::vector<size_t>
+    parse_list(std::string const &list)
+    {
+        std::vector<size_t> ret;
+        std::istringstream in(list);
+        std::string item;
+
+        while (std::getline(in, item, ','))
+        {
+            if (item.empty())
+                continue;
+
+            char *end;
+            auto lo = std::strtoul(item.c_str(), &end, 10);
+            auto hi = lo;
+
+            if (*end == '-')
+                hi = std::strtoul(end + 1, &end, 10);
+
+            if (end == item.c_str() || *end != '\0' || hi < lo)
+                throw std::runtime_error("invalid core list: " + list);
+
+            for(auto n = lo; n <= hi; n++)
+                ret.push_back(n);
+        }
+
+        return ret;
+    }
+
+
+    std::vector<size_t>
+    online()
+    {
+        auto s = read_line("/sys/devices/system/cpu/online");
+        if (s.empty())
+            throw std::runtime_error("topology: cannot read the online CPUs");
+        return parse_list(s);
+    }
+
+
+    int
+    nic_node(std::string const &ifname)
+    {
+        auto s = read_line("/sys/class/net/" + ifname + "/device/numa_node");
+        return s.empty() ? -1 : std::atoi(s.c_str());
+    }
+
+
+    int
+    cpu_node(size_t cpu)
+    {
+        // cpuN/nodeM is a link to the node...
+        //
+
+        auto dir = opendir(("/sys/devices/system/cpu/cpu" + std::to_string(cpu)).c_str());
+        if (!dir)
+            return -1;
+
+        int node = -1;
+        while (auto e = readdir(dir))
+        {
+            if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+                node = std::atoi(e->d_name + 4);
+                break;
+            }
+        }
+
+        closedir(dir);
+        return node;
+    }
+
+
+    size_t
+    core_id(size_t cpu)
+    {
+        auto s = read_line("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+        if (s.empty())
+            return cpu;
+        auto sib = parse_list(s);
+        return sib.empty() ? cpu : *std::min_element(sib.begin(), sib.end());
+    }
+
+
+    std::vector<size_t>
+    place(size_t nthreads, std::string const &ifname)
+    {
+        auto cpus = online();
+        auto node = ifname.empty() ? -1 : nic_node(ifname);
+
+        // one thread per physical core first...
+        //
+
+        std::vector<size_t> first, rest, used;
+        for(auto c : cpus)
+        {
+            auto id = core_id(c);
+            if (std::find(used.begin(), used.end(), id) == used.end()) {
+                used.push_back(id);
+                first.push_back(c);
+            }
+            else
+                rest.push_back(c);
+        }
+
+        // ...siblings only after the local physical cores are over, but
+        // still before the remote ones
+        //
+
+        std::vector<size_t> order;
+        auto local = [=](size_t c) { return node < 0 || cpu_node(c) == node; };
+
+        for(auto c : first) if (local(c))  order.push_back(c);
+        for(auto c : rest)  if (local(c))  order.push_back(c);
+        for(auto c : first) if (!local(c)) order.push_back(c);
+        for(auto c : rest)  if (!local(c)) order.push_back(c);
+
+        std::vector<size_t> ret;
+        for(size_t n = 0; n < nthreads; n++)
+            ret.push_back(order[n % order.size()]);
+        return ret;
+    }
+
+
+    void
+    check(std::vector<size_t> const &cores, std::string const &ifname)
+    {
+        auto node = ifname.empty() ? -1 : nic_node(ifname);
+
+        for(size_t i = 0; i < cores.size(); i++)
+        {
+            auto n = cpu_node(cores[i]);
+            if (node >= 0 && n >= 0 && n != node)
+                std::cerr << "warning: core " << cores[i] << " is on node " << n << ", " << ifname
+                          << " is on node " << node << " (remote memory access)" << std::endl;
+
+            for(size_t j = 0; j < i; j++)
+            {
+                if (cores[i] == cores[j])
+                    std::cerr << "warning: core " << cores[i] << " runs more than one thread" << std::endl;
+                else if (core_id(cores[i]) == core_id(cores[j]))
+                    std::cerr << "warning: cores " << cores[j] << " and " << cores[i]
+                              << " are siblings of the same physical core" << std::endl;
+            }
+        }
+    }
+
+
+    local_scope::local_scope(size_t cpu)
+    : restore(false)
+    {
+        if (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) != 0)
+            return;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        restore = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+
+    local_scope::~local_scope()
+    {
+        if (restore)
+            pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    }
+}